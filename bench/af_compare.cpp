@@ -0,0 +1,203 @@
+// af_compare.cpp
+// Checks that the CPU matcher gives the same ZSSD and ZNCC surfaces and
+// match scores as af::matchTemplate on 250x128 spectrogram-like images,
+// u8 and float, exits 1 when any case is outside the tolerance.
+// Only built with GPU_SUPPORT.
+#include <CpuMatch.h>
+#include <Util.h>
+#include <arrayfire.h>
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <vector>
+#include <cmath>
+
+#define IMAGE_WIDTH 250
+#define IMAGE_HEIGHT 128
+#define CASES 24
+// Largest difference over the surface range, and between the final scores
+#define SURFACE_TOLERANCE 1e-4
+#define SCORE_TOLERANCE 1e-3
+
+using namespace std;
+
+static unsigned int seed = 1;
+
+static float nextRandom()
+{
+    return nextBenchRandom(&seed);
+}
+
+// A few partials drifting over time on a noise floor, as rendered to the images
+static void makeImage(vector<float>* image, int shift, bool bU8)
+{
+    image->resize(IMAGE_WIDTH * IMAGE_HEIGHT);
+
+    for (int y = 0; y < IMAGE_HEIGHT; ++y)
+    {
+        for (int x = 0; x < IMAGE_WIDTH; ++x)
+        {
+            float v = 0.2f * nextRandom();
+
+            for (int p = 1; p <= 4; ++p)
+            {
+                const float band = p * IMAGE_HEIGHT / 5.0f + 6.0f * sinf((x + shift) * 0.03f * p);
+
+                v += expf(-0.5f * (y - band) * (y - band)) / p;
+            }
+
+            (*image)[y * IMAGE_WIDTH + x] = bU8 ? floorf(255.0f * fminf(v, 1.0f)) : v;
+        }
+    }
+}
+
+// 1 - normalize then the average peak, as scoreMatchResult
+static float scoreSurface(const float* result, PeakWorkspace* peaks, vector<float>* surface)
+{
+    const int count = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+    float mn = result[0], mx = result[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        mn = min(mn, result[i]);
+        mx = max(mx, result[i]);
+    }
+
+    const float range = mx > mn ? mx - mn : 1.0f;
+
+    surface->resize(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        (*surface)[i] = 1.0f - (result[i] - mn) / range;
+    }
+
+    const int found = findPeaksInto(&surface->front(), count, peaks);
+
+    float avgPeak = 0.0f;
+
+    for (int i = 0; i < found; ++i)
+    {
+        avgPeak += peaks->_peakMags[i];
+    }
+
+    return found > 0 ? avgPeak / found : 1.0f;
+}
+
+int main(int argc, const char** argv)
+{
+    const int count = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+    af::setDevice(0);
+
+    CpuMatcher matcher;
+
+    if (0 != initCpuMatcher(&matcher, IMAGE_WIDTH, IMAGE_HEIGHT, IMAGE_WIDTH, IMAGE_HEIGHT))
+    {
+        fprintf(stderr, "initCpuMatcher failed\n");
+        return 1;
+    }
+
+    PeakWorkspace peaks;
+
+    reservePeakWorkspace(&peaks, count);
+
+    vector<float> source, capture, expected(count), surface;
+    vector<unsigned char> sourceU8(count), captureU8(count);
+
+    double worstSurface[2] = { 0.0, 0.0 };
+    double worstScore[2] = { 0.0, 0.0 };
+    int failures = 0;
+
+    for (int c = 0; c < CASES; ++c)
+    {
+        const bool bU8 = c % 2 == 0;
+        const int metric = (c / 2) % 2 == 0 ? CPU_MATCH_ZSSD : CPU_MATCH_ZNCC;
+
+        // Every third pair is unrelated audio, the rest a shifted copy
+        makeImage(&source, 0, bU8);
+        makeImage(&capture, c % 3 == 2 ? 1000 + c : c * 3, bU8);
+
+        af::array tmpl(IMAGE_WIDTH, IMAGE_HEIGHT, bU8 ? u8 : f32);
+        af::array search(IMAGE_WIDTH, IMAGE_HEIGHT, bU8 ? u8 : f32);
+
+        if (bU8)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                sourceU8[i] = (unsigned char)source[i];
+                captureU8[i] = (unsigned char)capture[i];
+            }
+
+            tmpl.write(&sourceU8.front(), count);
+            search.write(&captureU8.front(), count);
+
+            setCpuMatchTemplate(&matcher, &sourceU8.front(), true);
+            setCpuMatchSearch(&matcher, &captureU8.front(), true);
+        }
+        else
+        {
+            tmpl.write(&source.front(), count * sizeof(float));
+            search.write(&capture.front(), count * sizeof(float));
+
+            setCpuMatchTemplate(&matcher, &source.front(), false);
+            setCpuMatchSearch(&matcher, &capture.front(), false);
+        }
+
+        runCpuMatch(&matcher, metric);
+
+        af::array result = af::matchTemplate(search, tmpl, metric == CPU_MATCH_ZSSD ? AF_ZSSD : AF_ZNCC);
+
+        result.host(&expected.front());
+
+        float mn = expected[0], mx = expected[0];
+        double difference = 0.0;
+
+        for (int i = 0; i < count; ++i)
+        {
+            mn = min(mn, expected[i]);
+            mx = max(mx, expected[i]);
+            difference = max(difference, fabs((double)matcher._result[i] - expected[i]));
+        }
+
+        difference /= mx > mn ? mx - mn : 1.0;
+
+        const float expectedScore = scoreSurface(&expected.front(), &peaks, &surface);
+        const float score = scoreSurface(matcher._result, &peaks, &surface);
+        const double scoreDifference = fabs((double)score - expectedScore);
+
+        worstSurface[metric] = max(worstSurface[metric], difference);
+        worstScore[metric] = max(worstScore[metric], scoreDifference);
+
+        if (difference > SURFACE_TOLERANCE || scoreDifference > SCORE_TOLERANCE)
+        {
+            fprintf(stderr, "case %d %s %s: surface %g score %f vs %f\n",
+                    c,
+                    bU8 ? "u8" : "f32",
+                    metric == CPU_MATCH_ZSSD ? "zssd" : "zncc",
+                    difference,
+                    score,
+                    expectedScore);
+
+            failures++;
+        }
+    }
+
+    deinitCpuMatcher(&matcher);
+
+    fprintf(stdout, "{\"benchmark\":\"af_compare\",\"width\":%d,\"height\":%d,\"cases\":%d,\"failures\":%d,\"isa\":\"%s\",\"results\":[\n"
+                    "  {\"metric\":\"zssd\",\"max_surface_error\":%g,\"max_score_error\":%g},\n"
+                    "  {\"metric\":\"zncc\",\"max_surface_error\":%g,\"max_score_error\":%g}\n]}\n",
+        IMAGE_WIDTH,
+        IMAGE_HEIGHT,
+        CASES,
+        failures,
+        getCpuMatchIsa(),
+        worstSurface[CPU_MATCH_ZSSD],
+        worstScore[CPU_MATCH_ZSSD],
+        worstSurface[CPU_MATCH_ZNCC],
+        worstScore[CPU_MATCH_ZNCC]);
+
+    return failures ? 1 : 0;
+}
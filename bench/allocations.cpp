@@ -0,0 +1,151 @@
+// allocations.cpp
+// Checks that steady state snapshots do not allocate, exits 1 when one does.
+#include <howl.h>
+#include <HowlContext.h>
+#include "alloc_count.h"
+
+#include <stdio.h>
+#include <vector>
+#include <cmath>
+
+#define SAMPLE_RATE 44100
+#define BUFFER_MS 1000
+#define CHUNK_SIZE 4096
+#define MAX_SPECTROGRAMS 3
+#define WARMUP_SECONDS 6
+#define MEASURE_SECONDS 10
+
+using namespace std;
+
+struct AllocationResult
+{
+    long long       _snapshots;
+    long long       _allocations;
+};
+
+static void makeSignal(vector<float>* samples, int count, double phase)
+{
+    samples->resize(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const double t = (double)i / SAMPLE_RATE + phase;
+
+        (*samples)[i] = (float)(0.5 * sin(2.0 * M_PI * (300.0 + 200.0 * sin(t)) * t));
+    }
+}
+
+static void feed(HowlLibContext* ctx, vector<float>& source, vector<float>& capture, bool bCapture)
+{
+    for (int offset = 0; offset + CHUNK_SIZE <= (int)source.size(); offset += CHUNK_SIZE)
+    {
+        feedSourceAudio(ctx, &source[offset], CHUNK_SIZE);
+
+        if (bCapture)
+        {
+            feedCaptureAudio(ctx, &capture[offset], CHUNK_SIZE);
+        }
+    }
+}
+
+// bCapture false leaves nothing to match, only the render path runs
+static int measure(int backend, bool bCapture, AllocationResult* result)
+{
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = backend;
+    config._maxSpectrograms = MAX_SPECTROGRAMS;
+    config._matchThreshold = 1e-6f;
+
+    HowlLibContext* ctx = createHowlLibContext();
+
+    if (!ctx || 0 != initHowlLibContextEx(ctx, SAMPLE_RATE, BUFFER_MS, NULL, &config))
+    {
+        destroyHowlLibContext(ctx);
+        return -1;
+    }
+
+    vector<float> warmSource, warmCapture, source, capture;
+
+    makeSignal(&warmSource, WARMUP_SECONDS * SAMPLE_RATE, 0.0);
+    makeSignal(&warmCapture, WARMUP_SECONDS * SAMPLE_RATE, 0.01);
+    makeSignal(&source, MEASURE_SECONDS * SAMPLE_RATE, WARMUP_SECONDS);
+    makeSignal(&capture, MEASURE_SECONDS * SAMPLE_RATE, WARMUP_SECONDS + 0.01);
+
+    // Fills the history of both streams and grows the pool to its steady size
+    feed(ctx, warmSource, warmCapture, bCapture);
+
+    HowlLibStats before, after;
+
+    getHowlLibStats(ctx, &before);
+
+    const long long allocs = allocations.load();
+
+    feed(ctx, source, capture, bCapture);
+
+    result->_allocations = allocations.load() - allocs;
+
+    getHowlLibStats(ctx, &after);
+
+    result->_snapshots = after._snapshots - before._snapshots;
+
+    destroyHowlLibContext(ctx);
+
+    return 0;
+}
+
+int main(int argc, const char** argv)
+{
+    struct { const char* _name; int _backend; } backends[] = {
+        { "cpu", HOWL_BACKEND_CPU },
+        { "fft", HOWL_BACKEND_FFT },
+        { "landmark", HOWL_BACKEND_LANDMARK },
+    };
+
+    const int backendCount = sizeof(backends) / sizeof(backends[0]);
+
+    struct { const char* _name; bool _bCapture; bool _bRequired; } paths[] = {
+        { "render", false, true },
+        { "snapshot", true, true },
+    };
+
+    int failed = 0;
+    bool bFirst = true;
+
+    fprintf(stdout, "{\"benchmark\":\"allocations\",\"results\":[\n");
+
+    for (int b = 0; b < backendCount; ++b)
+    {
+        for (int p = 0; p < 2; ++p)
+        {
+            AllocationResult result;
+
+            if (0 != measure(backends[b]._backend, paths[p]._bCapture, &result))
+            {
+                fprintf(stderr, "cannot init %s\n", backends[b]._name);
+                return 1;
+            }
+
+            const bool bPass = result._snapshots > 0 && result._allocations == 0;
+
+            failed += bPass || !paths[p]._bRequired ? 0 : 1;
+
+            fprintf(stdout, "%s  {\"backend\":\"%s\",\"path\":\"%s\",\"snapshots\":%lld,\"allocations\":%lld,\"required\":%s,\"pass\":%s}",
+                bFirst ? "" : ",\n",
+                backends[b]._name,
+                paths[p]._name,
+                result._snapshots,
+                result._allocations,
+                paths[p]._bRequired ? "true" : "false",
+                bPass ? "true" : "false");
+
+            bFirst = false;
+        }
+    }
+
+    fprintf(stdout, "\n]}\n");
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,128 @@
+// bench_signal.h
+// Test signals and recorded dumps shared by the benchmarks.
+#ifndef BENCH_SIGNAL_H
+#define BENCH_SIGNAL_H
+
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Floats read from a raw dump at a time
+#define BENCH_RAW_CHUNK 4096
+
+struct BenchSignal
+{
+    const char*         _name;
+    int                 _sampleRate;
+    std::vector<float>  _source;
+    std::vector<float>  _capture;
+};
+
+// One LCG for every bench, uniform in [0, 1) on 24 bits
+inline float nextBenchRandom(unsigned int* seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+
+    return (float)(*seed >> 8) / (float)(1 << 24);
+}
+
+// Tone sweeping sweepHz around 300 Hz with noise, seed picks the noise
+inline void makeBenchTone(std::vector<float>* samples, int count, int sampleRate, unsigned int seed, double sweepHz)
+{
+    samples->resize(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const double t = (double)i / sampleRate;
+        const double f = 300.0 + sweepHz * sin(t);
+
+        (*samples)[i] = (float)(0.5 * sin(2.0 * M_PI * f * t) + 0.1 * (nextBenchRandom(&seed) - 0.5));
+    }
+}
+
+// Short notes of random pitch with two harmonics on a faint noise floor, landmarks need onsets
+inline void makeBenchNotes(std::vector<float>* samples, int count, int sampleRate, unsigned int seed)
+{
+    samples->assign(count, 0.0f);
+
+    for (int start = 0; start < count; )
+    {
+        seed = seed * 1664525u + 1013904223u;
+
+        const int length = sampleRate / 12 + (int)((seed >> 8) % (sampleRate / 6));
+        const double f = 200.0 + (double)((seed >> 4) % 1800);
+
+        for (int i = 0; i < length && start + i < count; ++i)
+        {
+            const double t = (double)i / sampleRate;
+            const double envelope = exp(-6.0 * i / length);
+
+            (*samples)[start + i] = (float)(envelope * (0.5 * sin(2.0 * M_PI * f * t) +
+                                                        0.2 * sin(4.0 * M_PI * f * t) +
+                                                        0.1 * sin(6.0 * M_PI * f * t)));
+        }
+
+        start += length;
+    }
+
+    for (int i = 0; i < count; ++i)
+    {
+        (*samples)[i] += 0.01f * (nextBenchRandom(&seed) - 0.5f);
+    }
+}
+
+// Capture is the source played back lag samples later, attenuated
+inline void makeBenchLoop(BenchSignal* signal, int lag)
+{
+    signal->_capture.assign(signal->_source.size(), 0.0f);
+
+    for (int i = lag; i < (int)signal->_source.size(); ++i)
+    {
+        signal->_capture[i] = 0.8f * signal->_source[i - lag];
+    }
+}
+
+// float32 dump as written by test/howl
+inline bool loadBenchRaw(const char* path, std::vector<float>* samples)
+{
+    FILE* f = fopen(path, "rb");
+
+    if (!f)
+    {
+        return false;
+    }
+
+    float chunk[BENCH_RAW_CHUNK];
+    size_t count;
+
+    while ((count = fread(chunk, sizeof(float), BENCH_RAW_CHUNK, f)) > 0)
+    {
+        samples->insert(samples->end(), chunk, chunk + count);
+    }
+
+    fclose(f);
+
+    return !samples->empty();
+}
+
+// Both dumps of a test/howl run, cut to the shorter one
+inline bool loadBenchRecording(BenchSignal* signal, const char* sourcePath, const char* capturePath, int sampleRate)
+{
+    signal->_name = "recorded";
+    signal->_sampleRate = sampleRate;
+
+    if (!loadBenchRaw(sourcePath, &signal->_source) || !loadBenchRaw(capturePath, &signal->_capture))
+    {
+        return false;
+    }
+
+    const size_t samples = std::min(signal->_source.size(), signal->_capture.size());
+
+    signal->_source.resize(samples);
+    signal->_capture.resize(samples);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,210 @@
+// drops.cpp
+// Checks that audio dropped by a full queue still advances its stream:
+// the capture is the source 250ms later, one capture feed too large for
+// the queue is refused, and every match before and after it has to be
+// at the true lag. Runs the analysis thread and an engine pair, exits 1
+// on a wrong lag, no match after the drop, or a stream left behind.
+#include <HowlContext.h>
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+#define SAMPLE_RATE 44100
+#define BUFFER_MS 1000
+#define SIGNAL_SECONDS 12
+#define CHUNK_SIZE 4096
+#define LAG_SAMPLES (SAMPLE_RATE / 4)
+#define QUEUE_MS 200
+// Larger than the queue rounded up so always refused, a multiple of CHUNK_SIZE
+#define DROP_SAMPLES 32768
+#define DROP_AT (5 * SAMPLE_RATE)
+#define WAIT_MS 5000
+
+using namespace std;
+
+struct BenchRun
+{
+    vector<HowlMatchEvent>  _matches;
+};
+
+static void matchDetected(void* userData, const HowlMatchEvent* event)
+{
+    BenchRun* run = (BenchRun*)userData;
+
+    run->_matches.push_back(*event);
+}
+
+// Analysis is done once both rings count every sample fed, refused ones included
+static bool waitForAnalysis(HowlLibContext* ctx, long long sourceFed, long long captureFed)
+{
+    for (int i = 0; i < WAIT_MS; ++i)
+    {
+        if (getAudioRingPosition(ctx->_source._ringBuffer) == sourceFed &&
+            getAudioRingPosition(ctx->_capture._ringBuffer) == captureFed)
+        {
+            return true;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return false;
+}
+
+// Each feed is analysed before the next. The refused feed stands for the
+// capture of DROP_SAMPLES of playback, the source goes on meanwhile.
+static bool feedWithDrop(HowlLibContext* ctx, const vector<float>& source, const vector<float>& capture)
+{
+    vector<float> chunk(DROP_SAMPLES);
+
+    const int total = (int)source.size();
+
+    long long captureFed = 0;
+    bool bDropped = false;
+
+    for (int offset = 0; offset < total; offset += CHUNK_SIZE)
+    {
+        const int count = total - offset < CHUNK_SIZE ? total - offset : CHUNK_SIZE;
+
+        copy(source.begin() + offset, source.begin() + offset + count, chunk.begin());
+        feedSourceAudio(ctx, &chunk.front(), count);
+
+        // Nothing to feed until the source is past the refused capture
+        if (captureFed == offset)
+        {
+            const int captureCount = !bDropped && offset >= DROP_AT && offset + DROP_SAMPLES <= total ? DROP_SAMPLES : count;
+
+            copy(capture.begin() + offset, capture.begin() + offset + captureCount, chunk.begin());
+            feedCaptureAudio(ctx, &chunk.front(), captureCount);
+
+            captureFed += captureCount;
+            bDropped = bDropped || captureCount == DROP_SAMPLES;
+        }
+
+        if (!waitForAnalysis(ctx, offset + count, captureFed))
+        {
+            fprintf(stderr, "stream positions stopped at %lld %lld, fed %d %lld\n",
+                    getAudioRingPosition(ctx->_source._ringBuffer),
+                    getAudioRingPosition(ctx->_capture._ringBuffer),
+                    offset + count,
+                    captureFed);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int checkRun(const char* mode, HowlLibContext* ctx, const BenchRun& run, bool bFed, bool bFirst)
+{
+    HowlLibStats stats;
+
+    getHowlLibStats(ctx, &stats);
+
+    long long worst = 0;
+    int afterDrop = 0;
+
+    for (size_t i = 0; i < run._matches.size(); ++i)
+    {
+        const HowlMatchEvent& event = run._matches[i];
+        const long long error = llabs(event._capturePosition - event._sourcePosition - LAG_SAMPLES);
+
+        worst = error > worst ? error : worst;
+
+        // Windows that start after the dropped audio
+        afterDrop += event._capturePosition - ctx->_bufferSize >= DROP_AT + DROP_SAMPLES ? 1 : 0;
+    }
+
+    // Two landmark columns, positions are floored to columns on both streams
+    const long long tolerance = 2 * ctx->_bufferSize / ctx->_config._spectrogramWidth;
+
+    const bool bPass = bFed &&
+                       stats._droppedSamples == DROP_SAMPLES &&
+                       afterDrop > 0 &&
+                       worst <= tolerance;
+
+    fprintf(stdout, "%s  {\"mode\":\"%s\",\"dropped_samples\":%lld,\"matches\":%d,\"matches_after_drop\":%d,"
+                    "\"worst_lag_error\":%lld,\"tolerance\":%lld,\"pass\":%s}",
+        bFirst ? "" : ",\n",
+        mode,
+        stats._droppedSamples,
+        (int)run._matches.size(),
+        afterDrop,
+        worst,
+        tolerance,
+        bPass ? "true" : "false");
+
+    return bPass ? 0 : 1;
+}
+
+int main(int argc, const char** argv)
+{
+    BenchSignal signal;
+
+    signal._name = "notes";
+    signal._sampleRate = SAMPLE_RATE;
+
+    makeBenchNotes(&signal._source, SIGNAL_SECONDS * SAMPLE_RATE, SAMPLE_RATE, 1);
+    makeBenchLoop(&signal, LAG_SAMPLES);
+
+    const vector<float>& source = signal._source;
+    const vector<float>& capture = signal._capture;
+
+    int failures = 0;
+
+    fprintf(stdout, "{\"benchmark\":\"drops\",\"lag\":%d,\"drop\":%d,\"results\":[\n", LAG_SAMPLES, DROP_SAMPLES);
+
+    {
+        BenchRun run;
+
+        HowlLibContext* ctx = createHowlLibContext();
+
+        if (!ctx ||
+            0 != initHowlLibContextBackend(ctx, SAMPLE_RATE, BUFFER_MS, NULL, HOWL_BACKEND_LANDMARK) ||
+            0 != setHowlLibMatchCallback(ctx, matchDetected, &run) ||
+            0 != startHowlLibAnalysisThread(ctx, QUEUE_MS))
+        {
+            fprintf(stderr, "cannot init the analysis thread\n");
+            return 1;
+        }
+
+        const bool bFed = feedWithDrop(ctx, source, capture);
+
+        failures += checkRun("analysis_thread", ctx, run, bFed, true);
+
+        destroyHowlLibContext(ctx);
+    }
+
+    {
+        BenchRun run;
+
+        HowlEngine* engine = createHowlEngine();
+        HowlLibContext* ctx = createHowlLibContext();
+
+        // The deadline never drops here, only the full queue does
+        if (!engine || !ctx ||
+            0 != initHowlEngine(engine, SAMPLE_RATE, BUFFER_MS, HOWL_BACKEND_LANDMARK, 1) ||
+            0 != initHowlLibContextEngine(ctx, engine, NULL, QUEUE_MS, WAIT_MS) ||
+            0 != setHowlLibMatchCallback(ctx, matchDetected, &run))
+        {
+            fprintf(stderr, "cannot init the engine\n");
+            return 1;
+        }
+
+        const bool bFed = feedWithDrop(ctx, source, capture);
+
+        failures += checkRun("engine", ctx, run, bFed, false);
+
+        destroyHowlLibContext(ctx);
+        destroyHowlEngine(engine);
+    }
+
+    fprintf(stdout, "\n]}\n");
+
+    return failures ? 1 : 0;
+}
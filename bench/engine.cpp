@@ -0,0 +1,240 @@
+// engine.cpp
+// Runs many source/capture pairs on one HowlEngine in realtime: a feeding
+// thread hands every pair CHUNK_MS of both streams per tick, as sound
+// cards would. Each capture is its source played back 50 to 225ms later.
+// Exits 1 when audio was refused or dropped past the deadline, a pair
+// matched at a wrong lag or never matched, or analysis did not catch up.
+// ./engine [pairs [workers [seconds]]], 256 pairs and one worker per
+// hardware thread by default.
+#include <HowlContext.h>
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+
+#define SAMPLE_RATE 44100
+#define BUFFER_MS 1000
+#define CHUNK_MS 10
+#define QUEUE_MS 1000
+#define DEADLINE_MS 500
+#define SIGNALS 8
+#define PAIRS 256
+#define SECONDS 10
+#define CATCH_UP_MS 10000
+
+using namespace std;
+
+struct BenchPair
+{
+    HowlLibContext*     _ctx;
+    const vector<float>* _source;
+    int                 _lag;
+    int                 _matches;
+    long long           _worstError;
+    std::mutex          _mutex; // Any worker can report
+};
+
+static long long tolerance = 0;
+
+static void matchDetected(void* userData, const HowlMatchEvent* event)
+{
+    BenchPair* pair = (BenchPair*)userData;
+
+    const long long error = llabs(event->_capturePosition - event->_sourcePosition - pair->_lag);
+
+    std::lock_guard<std::mutex> lock(pair->_mutex);
+
+    pair->_matches++;
+    pair->_worstError = error > pair->_worstError ? error : pair->_worstError;
+}
+
+static void addHistogram(HowlLatencyHistogram* total, const HowlLatencyHistogram& histogram)
+{
+    total->_count += histogram._count;
+    total->_totalUs += histogram._totalUs;
+    total->_maxUs = histogram._maxUs > total->_maxUs ? histogram._maxUs : total->_maxUs;
+
+    for (int i = 0; i < HOWL_STATS_BUCKETS; ++i)
+    {
+        total->_buckets[i] += histogram._buckets[i];
+    }
+}
+
+// Upper bound of the bucket holding the 99th percentile, as bench/pipeline
+static long long getP99Below(const HowlLatencyHistogram& histogram)
+{
+    long long below = 0;
+    int bucket = 0;
+
+    while (bucket < HOWL_STATS_BUCKETS - 1 && (below += histogram._buckets[bucket]) * 100 < histogram._count * 99)
+    {
+        ++bucket;
+    }
+
+    return 1LL << bucket;
+}
+
+static bool caughtUp(vector<BenchPair>& pairs, long long fed)
+{
+    for (size_t p = 0; p < pairs.size(); ++p)
+    {
+        if (getAudioRingPosition(pairs[p]._ctx->_source._ringBuffer) != fed ||
+            getAudioRingPosition(pairs[p]._ctx->_capture._ringBuffer) != fed)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, const char** argv)
+{
+    const int pairCount = argc > 1 ? atoi(argv[1]) : PAIRS;
+    const int workers = argc > 2 ? atoi(argv[2]) : 0;
+    const int seconds = argc > 3 ? atoi(argv[3]) : SECONDS;
+
+    if (pairCount <= 0 || seconds <= 0)
+    {
+        fprintf(stderr, "usage: engine [pairs [workers [seconds]]]\n");
+        return 1;
+    }
+
+    const int total = seconds * SAMPLE_RATE;
+    const int chunk = CHUNK_MS * SAMPLE_RATE / 1000;
+
+    // Pairs share a few sources, each with its own lag
+    vector<vector<float> > signals(SIGNALS);
+
+    for (int s = 0; s < SIGNALS; ++s)
+    {
+        makeBenchNotes(&signals[s], total, SAMPLE_RATE, s + 1);
+    }
+
+    HowlEngine* engine = createHowlEngine();
+
+    if (!engine || 0 != initHowlEngine(engine, SAMPLE_RATE, BUFFER_MS, HOWL_BACKEND_LANDMARK, workers))
+    {
+        fprintf(stderr, "cannot init the engine\n");
+        return 1;
+    }
+
+    vector<BenchPair> pairs(pairCount);
+
+    for (int p = 0; p < pairCount; ++p)
+    {
+        BenchPair& pair = pairs[p];
+
+        pair._source = &signals[p % SIGNALS];
+        pair._lag = SAMPLE_RATE / 20 + (p / SIGNALS % 8) * SAMPLE_RATE / 40;
+        pair._matches = 0;
+        pair._worstError = 0;
+        pair._ctx = createHowlLibContext();
+
+        if (!pair._ctx ||
+            0 != initHowlLibContextEngine(pair._ctx, engine, NULL, QUEUE_MS, DEADLINE_MS) ||
+            0 != setHowlLibMatchCallback(pair._ctx, matchDetected, &pair))
+        {
+            fprintf(stderr, "cannot init pair %d\n", p);
+            return 1;
+        }
+    }
+
+    // Two landmark columns, positions are floored to columns on both streams
+    tolerance = 2 * pairs[0]._ctx->_bufferSize / pairs[0]._ctx->_config._spectrogramWidth;
+
+    vector<float> capture(chunk);
+
+    int refused = 0;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Realtime, the next tick is due CHUNK_MS after the previous one whatever the feeds cost
+    for (int offset = 0, tick = 0; offset + chunk <= total; offset += chunk, ++tick)
+    {
+        std::this_thread::sleep_until(start + std::chrono::milliseconds((long long)tick * CHUNK_MS));
+
+        for (int p = 0; p < pairCount; ++p)
+        {
+            const BenchPair& pair = pairs[p];
+            const vector<float>& source = *pair._source;
+
+            for (int i = 0; i < chunk; ++i)
+            {
+                capture[i] = offset + i >= pair._lag ? 0.8f * source[offset + i - pair._lag] : 0.0f;
+            }
+
+            refused += feedSourceAudio(pair._ctx, const_cast<float*>(&source[offset]), chunk) != 0 ? 1 : 0;
+            refused += feedCaptureAudio(pair._ctx, &capture.front(), chunk) != 0 ? 1 : 0;
+        }
+    }
+
+    const long long fed = (long long)(total / chunk) * chunk;
+
+    bool bCaughtUp = false;
+
+    for (int i = 0; i < CATCH_UP_MS && !(bCaughtUp = caughtUp(pairs, fed)); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    HowlLatencyHistogram detection = {};
+    HowlLatencyHistogram feed = {};
+
+    long long late = 0, dropped = 0, worst = 0;
+    int matched = 0, wrongLag = 0;
+
+    for (int p = 0; p < pairCount; ++p)
+    {
+        HowlLibStats stats;
+
+        getHowlLibStats(pairs[p]._ctx, &stats);
+
+        addHistogram(&detection, stats._detection);
+        addHistogram(&feed, stats._feed);
+
+        late += stats._lateSamples;
+        dropped += stats._droppedSamples;
+
+        destroyHowlLibContext(pairs[p]._ctx);
+
+        matched += pairs[p]._matches > 0 ? 1 : 0;
+        wrongLag += pairs[p]._worstError > tolerance ? 1 : 0;
+        worst = pairs[p]._worstError > worst ? pairs[p]._worstError : worst;
+    }
+
+    destroyHowlEngine(engine);
+
+    const bool bPass = bCaughtUp && refused == 0 && late == 0 && dropped == 0 && matched == pairCount && wrongLag == 0;
+
+    fprintf(stdout, "{\"benchmark\":\"engine\",\"pairs\":%d,\"workers\":%d,\"seconds\":%d,\"chunk_ms\":%d,\"deadline_ms\":%d,\n"
+                    "  \"caught_up\":%s,\"refused_feeds\":%d,\"late_samples\":%lld,\"dropped_samples\":%lld,"
+                    "\"pairs_matched\":%d,\"pairs_wrong_lag\":%d,\"worst_lag_error\":%lld,\"tolerance\":%lld,\n"
+                    "  \"detection_us_avg\":%.0f,\"detection_p99_us_below\":%lld,\"detection_max_us\":%lld,"
+                    "\"feed_us_avg\":%.1f,\"feed_p99_us_below\":%lld,\"pass\":%s}\n",
+        pairCount,
+        workers > 0 ? workers : (int)std::thread::hardware_concurrency(),
+        seconds,
+        CHUNK_MS,
+        DEADLINE_MS,
+        bCaughtUp ? "true" : "false",
+        refused,
+        late,
+        dropped,
+        matched,
+        wrongLag,
+        worst,
+        tolerance,
+        detection._count > 0 ? (double)detection._totalUs / detection._count : 0.0,
+        getP99Below(detection),
+        detection._maxUs,
+        feed._count > 0 ? (double)feed._totalUs / feed._count : 0.0,
+        getP99Below(feed),
+        bPass ? "true" : "false");
+
+    return bPass ? 0 : 1;
+}
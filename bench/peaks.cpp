@@ -0,0 +1,184 @@
+// peaks.cpp
+// Checks that findPeaksInto finds the same peaks as findPeaks and times both
+// on 250x128 correlation surfaces, exits 1 on any mismatch or allocation.
+#include <Util.h>
+#include "alloc_count.h"
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <vector>
+#include <chrono>
+#include <cmath>
+
+#define SURFACE_WIDTH 250
+#define SURFACE_HEIGHT 128
+#define RANDOM_CASES 20000
+#define BENCH_REPEAT 200
+
+using namespace std;
+
+static unsigned int seed = 1;
+
+static float nextRandom()
+{
+    return nextBenchRandom(&seed);
+}
+
+static double nowNs()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Normalized like scoreMatchResult, a broad ridge with noise and flat runs
+static void makeSurface(vector<float>* surface, int width, int height, int kind)
+{
+    const int count = width * height;
+
+    surface->resize(count);
+
+    const float cx = nextRandom() * width;
+    const float cy = nextRandom() * height;
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const float d = ((x - cx) * (x - cx) + (y - cy) * (y - cy)) / (float)(width * height);
+
+            float v = expf(-8.0f * d) + 0.3f * nextRandom();
+
+            // Plateaus, ties and exact zero steps are where the two could differ
+            if (kind == 1)
+            {
+                v = floorf(v * 8.0f) / 8.0f;
+            }
+            else if (kind == 2 && nextRandom() < 0.3f)
+            {
+                v = 0.5f;
+            }
+
+            (*surface)[y * width + x] = v;
+        }
+    }
+
+    float mn = (*surface)[0], mx = (*surface)[0];
+
+    for (int i = 0; i < count; ++i)
+    {
+        mn = min(mn, (*surface)[i]);
+        mx = max(mx, (*surface)[i]);
+    }
+
+    const float range = mx > mn ? mx - mn : 1.0f;
+
+    for (int i = 0; i < count; ++i)
+    {
+        (*surface)[i] = 1.0f - ((*surface)[i] - mn) / range;
+    }
+}
+
+static bool samePeaks(const vector<float>& surface, PeakWorkspace* workspace)
+{
+    vector<int> expected;
+
+    findPeaks(surface, expected);
+
+    const int found = findPeaksInto(&surface.front(), (int)surface.size(), workspace);
+
+    if (found != (int)expected.size())
+    {
+        return false;
+    }
+
+    for (int i = 0; i < found; ++i)
+    {
+        if (workspace->_peakInds[i] != expected[i] || workspace->_peakMags[i] != surface[expected[i]])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, const char** argv)
+{
+    PeakWorkspace workspace;
+
+    reservePeakWorkspace(&workspace, SURFACE_WIDTH * SURFACE_HEIGHT);
+
+    vector<float> surface;
+
+    int mismatches = 0;
+
+    // Short inputs of every length, the first point handling and the end point matter most there
+    for (int c = 0; c < RANDOM_CASES; ++c)
+    {
+        const int length = 3 + c % 61;
+
+        surface.resize(length);
+
+        for (int i = 0; i < length; ++i)
+        {
+            const float v = nextRandom();
+
+            surface[i] = c % 3 == 0 ? floorf(v * 4.0f) : v;
+        }
+
+        mismatches += samePeaks(surface, &workspace) ? 0 : 1;
+    }
+
+    for (int c = 0; c < 60; ++c)
+    {
+        makeSurface(&surface, SURFACE_WIDTH, SURFACE_HEIGHT, c % 3);
+
+        mismatches += samePeaks(surface, &workspace) ? 0 : 1;
+    }
+
+    makeSurface(&surface, SURFACE_WIDTH, SURFACE_HEIGHT, 0);
+
+    vector<int> peaks;
+    long long found = 0;
+
+    long long allocs = allocations.load();
+    double start = nowNs();
+
+    for (int i = 0; i < BENCH_REPEAT; ++i)
+    {
+        peaks.clear();
+
+        findPeaks(surface, peaks);
+
+        found += peaks.size();
+    }
+
+    const double findPeaksNs = (nowNs() - start) / BENCH_REPEAT;
+    const double findPeaksAllocs = (double)(allocations.load() - allocs) / BENCH_REPEAT;
+
+    allocs = allocations.load();
+    start = nowNs();
+
+    for (int i = 0; i < BENCH_REPEAT; ++i)
+    {
+        found += findPeaksInto(&surface.front(), (int)surface.size(), &workspace);
+    }
+
+    const double findPeaksIntoNs = (nowNs() - start) / BENCH_REPEAT;
+    const long long findPeaksIntoAllocs = allocations.load() - allocs;
+
+    fprintf(stderr, "peaks %lld\n", found);
+
+    fprintf(stdout, "{\"benchmark\":\"peaks\",\"width\":%d,\"height\":%d,\"mismatches\":%d,\"results\":[\n"
+                    "  {\"function\":\"findPeaks\",\"ns_per_call\":%.1f,\"allocations_per_call\":%.2f},\n"
+                    "  {\"function\":\"findPeaksInto\",\"ns_per_call\":%.1f,\"allocations_per_call\":%.2f}\n]}\n",
+        SURFACE_WIDTH,
+        SURFACE_HEIGHT,
+        mismatches,
+        findPeaksNs,
+        findPeaksAllocs,
+        findPeaksIntoNs,
+        (double)findPeaksIntoAllocs / BENCH_REPEAT);
+
+    return mismatches || findPeaksIntoAllocs ? 1 : 0;
+}
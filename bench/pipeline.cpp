@@ -0,0 +1,435 @@
+// pipeline.cpp
+// Times each stage of the detection pipeline and counts heap allocations.
+// ./pipeline [sourceraw captureraw] adds the recorded float32 dumps of test/howl.
+#include <HowlContext.h>
+#include <Util.h>
+#include "alloc_count.h"
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cmath>
+
+#ifdef GPU_SUPPORT
+#include <arrayfire.h>
+#endif
+
+#define SIGNAL_SECONDS 12
+#define CHUNK_SIZE 4096
+#define RENDER_REPEAT 32
+#define MATCH_REPEAT 8
+// Async queue holds the whole signal, feeds are timed without drops
+#define QUEUE_MS ((SIGNAL_SECONDS + 1) * 1000)
+
+using namespace std;
+
+static bool bFirstResult = true;
+
+static double nowNs()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// samples is the audio the stage stands for, so per snapshot stages are amortized per input sample
+static void printStage(const BenchSignal& signal, int bufferMs, const char* backend, const char* stage,
+                       double ns, long long calls, double samples, long long allocs)
+{
+    fprintf(stdout, "%s  {\"signal\":\"%s\",\"sample_rate\":%d,\"buffer_ms\":%d,\"backend\":\"%s\",\"stage\":\"%s\","
+                    "\"calls\":%lld,\"ns_per_call\":%.1f,\"ns_per_sample\":%.3f,\"allocations_per_call\":%.2f}",
+        bFirstResult ? "" : ",\n",
+        signal._name,
+        signal._sampleRate,
+        bufferMs,
+        backend,
+        stage,
+        calls,
+        calls > 0 ? ns / calls : 0.0,
+        samples > 0 ? ns / samples : 0.0,
+        calls > 0 ? (double)allocs / calls : 0.0);
+
+    bFirstResult = false;
+}
+
+// Feed call latencies from the context's _feed histogram, microseconds
+static void printFeedLatency(const BenchSignal& signal, int bufferMs, const char* backend, const char* stage,
+                             const HowlLibStats& stats)
+{
+    const HowlLatencyHistogram& feed = stats._feed;
+
+    // Upper bound of the bucket holding the 99th percentile
+    long long below = 0;
+    int bucket = 0;
+
+    while (bucket < HOWL_STATS_BUCKETS - 1 && (below += feed._buckets[bucket]) * 100 < feed._count * 99)
+    {
+        ++bucket;
+    }
+
+    fprintf(stdout, "%s  {\"signal\":\"%s\",\"sample_rate\":%d,\"buffer_ms\":%d,\"backend\":\"%s\",\"stage\":\"%s\","
+                    "\"calls\":%lld,\"us_per_call\":%.1f,\"p99_us_below\":%lld,\"max_us\":%lld,\"dropped_samples\":%lld}",
+        bFirstResult ? "" : ",\n",
+        signal._name,
+        signal._sampleRate,
+        bufferMs,
+        backend,
+        stage,
+        feed._count,
+        feed._count > 0 ? (double)feed._totalUs / feed._count : 0.0,
+        1LL << bucket,
+        feed._maxUs,
+        stats._droppedSamples);
+
+    bFirstResult = false;
+}
+
+// Capture is the source played back 50ms later, attenuated
+static void makeSynthetic(BenchSignal* signal, int sampleRate)
+{
+    signal->_name = "synthetic";
+    signal->_sampleRate = sampleRate;
+
+    makeBenchTone(&signal->_source, SIGNAL_SECONDS * sampleRate, sampleRate, 1, 200.0);
+    makeBenchLoop(signal, sampleRate / 20);
+}
+
+static HowlLibContext* createBenchContext(int sampleRate, int bufferMs, int backend)
+{
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = backend;
+    // Scores are computed either way, nothing is printed into the json
+    config._matchThreshold = 1e-6f;
+
+    HowlLibContext* ctx = createHowlLibContext();
+
+    if (ctx && 0 != initHowlLibContextEx(ctx, sampleRate, bufferMs, NULL, &config))
+    {
+        destroyHowlLibContext(ctx);
+        return nullptr;
+    }
+
+    return ctx;
+}
+
+// Ring writes and stft updates over the whole source, as a feed would do them
+static void benchStreamStages(const BenchSignal& signal, int bufferMs, HowlLibContext* ctx)
+{
+    HowlStream* stream = &ctx->_source;
+    const vector<float>& samples = signal._source;
+    const int total = (int)samples.size();
+
+    double ringNs = 0, stftNs = 0;
+    long long ringAllocs = 0, stftAllocs = 0, calls = 0;
+
+    for (int offset = 0; offset < total; offset += CHUNK_SIZE)
+    {
+        const int count = total - offset < CHUNK_SIZE ? total - offset : CHUNK_SIZE;
+
+        long long allocs = allocations.load();
+        double start = nowNs();
+
+        writeAudioRing(stream->_ringBuffer, &samples[offset], count);
+
+        double written = nowNs();
+        long long writtenAllocs = allocations.load();
+
+        updateStftStream(stream->_stft, stream->_ringBuffer);
+
+        stftNs += nowNs() - written;
+        ringNs += written - start;
+        stftAllocs += allocations.load() - writtenAllocs;
+        ringAllocs += writtenAllocs - allocs;
+        ++calls;
+    }
+
+    printStage(signal, bufferMs, "-", "ring_write", ringNs, calls, total, ringAllocs);
+    printStage(signal, bufferMs, "-", "stft_update", stftNs, calls, total, stftAllocs);
+}
+
+// Per snapshot stages on renders of the last source and capture windows
+static void benchSnapshotStages(const BenchSignal& signal, int bufferMs, HowlLibContext* ctx, const char* backend)
+{
+    const HowlLibConfig& config = ctx->_config;
+
+    HowlStream* streams[2] = { &ctx->_source, &ctx->_capture };
+    const vector<float>* samples[2] = { &signal._source, &signal._capture };
+    SpectrumRender* renders[2] = { nullptr, nullptr };
+
+    for (int s = 0; s < 2; ++s)
+    {
+        writeAudioRing(streams[s]->_ringBuffer, &samples[s]->front(), (int)samples[s]->size());
+        updateStftStream(streams[s]->_stft, streams[s]->_ringBuffer);
+
+        renders[s] = createNewRender(config._spectrogramWidth, config._spectrogramHeight, SPECTROGRAM_FORMAT);
+
+        if (!renders[s])
+        {
+            return;
+        }
+    }
+
+    const double hop = ctx->_snapshotHop;
+    MatchWorkspace* workspace = ctx->_source._workspace;
+
+    long long allocs = allocations.load();
+    double start = nowNs();
+
+    for (int i = 0; i < RENDER_REPEAT; ++i)
+    {
+        fillRender(renders[i & 1], streams[i & 1]->_stft, config._rangeDb);
+    }
+
+    printStage(signal, bufferMs, backend, "render_fill", nowNs() - start, RENDER_REPEAT, RENDER_REPEAT * hop, allocations.load() - allocs);
+
+    prepareRender(ctx, streams[0], workspace, renders[0]);
+    prepareRender(ctx, streams[1], workspace, renders[1]);
+
+#ifdef GPU_SUPPORT
+    if (config._backend == HOWL_BACKEND_ARRAYFIRE)
+    {
+        const size_t imageBytes = (size_t)config._spectrogramWidth * config._spectrogramHeight;
+
+        af::array image(config._spectrogramWidth, config._spectrogramHeight, u8);
+
+        af::sync();
+
+        allocs = allocations.load();
+        start = nowNs();
+
+        for (int i = 0; i < RENDER_REPEAT; ++i)
+        {
+            image.write(renders[i & 1]->_image, imageBytes);
+        }
+
+        af::sync();
+
+        printStage(signal, bufferMs, backend, "af_upload", nowNs() - start, RENDER_REPEAT, RENDER_REPEAT * hop, allocations.load() - allocs);
+    }
+#endif
+
+    float score = 0.0f;
+
+    allocs = allocations.load();
+    start = nowNs();
+
+    for (int i = 0; i < MATCH_REPEAT; ++i)
+    {
+        score += matchRenders(ctx, workspace, renders[0], renders[1]);
+    }
+
+    printStage(signal, bufferMs, backend, "match", nowNs() - start, MATCH_REPEAT, MATCH_REPEAT * hop, allocations.load() - allocs);
+
+    // Normalize and peak scoring on the surface of the last cpu match
+    if (workspace->_cpuMatcher)
+    {
+        const int pixels = config._spectrogramWidth * config._spectrogramHeight;
+        const float* result = workspace->_cpuMatcher->_result;
+
+        allocs = allocations.load();
+        start = nowNs();
+
+        for (int i = 0; i < MATCH_REPEAT; ++i)
+        {
+            score += scoreMatchResult(workspace, result, pixels);
+        }
+
+        printStage(signal, bufferMs, backend, "normalize_peaks", nowNs() - start, MATCH_REPEAT, MATCH_REPEAT * hop, allocations.load() - allocs);
+
+        vector<float> surface(result, result + pixels);
+        vector<int> peaks;
+
+        allocs = allocations.load();
+        start = nowNs();
+
+        for (int i = 0; i < MATCH_REPEAT; ++i)
+        {
+            peaks.clear();
+
+            findPeaks(surface, peaks);
+        }
+
+        printStage(signal, bufferMs, backend, "find_peaks", nowNs() - start, MATCH_REPEAT, MATCH_REPEAT * hop, allocations.load() - allocs);
+    }
+
+    fprintf(stderr, "score %f\n", score);
+
+    releaseRender(renders[0]);
+    releaseRender(renders[1]);
+}
+
+// Both streams in chunks through the feeds, each copied first as the feeds take non-const samples
+static void feedSignal(const BenchSignal& signal, HowlLibContext* ctx, vector<float>* chunk, double* feedNs)
+{
+    const int total = (int)signal._source.size();
+
+    *feedNs = 0;
+
+    for (int offset = 0; offset < total; offset += CHUNK_SIZE)
+    {
+        const int count = total - offset < CHUNK_SIZE ? total - offset : CHUNK_SIZE;
+
+        copy(signal._source.begin() + offset, signal._source.begin() + offset + count, chunk->begin());
+
+        double start = nowNs();
+
+        feedSourceAudio(ctx, &chunk->front(), count);
+
+        *feedNs += nowNs() - start;
+
+        copy(signal._capture.begin() + offset, signal._capture.begin() + offset + count, chunk->begin());
+
+        start = nowNs();
+
+        feedCaptureAudio(ctx, &chunk->front(), count);
+
+        *feedNs += nowNs() - start;
+    }
+}
+
+// Synchronous feeds, renders, publishing and checkAllRenders included
+static void benchPipeline(const BenchSignal& signal, int bufferMs, HowlLibContext* ctx, const char* backend)
+{
+    const int total = (int)signal._source.size();
+
+    vector<float> chunk(CHUNK_SIZE);
+    double ns;
+
+    long long allocs = allocations.load();
+
+    feedSignal(signal, ctx, &chunk, &ns);
+
+    const long long snapshots = ctx->_source._renderCount + ctx->_capture._renderCount;
+
+    printStage(signal, bufferMs, backend, "pipeline", ns, snapshots, 2.0 * total, allocations.load() - allocs);
+
+    HowlLibStats stats;
+
+    getHowlLibStats(ctx, &stats);
+
+    printFeedLatency(signal, bufferMs, backend, "feed_sync", stats);
+}
+
+// Feeds of the analysis thread only copy into its queue
+static void benchAsyncFeed(const BenchSignal& signal, int bufferMs, HowlLibContext* ctx, const char* backend)
+{
+    if (0 != startHowlLibAnalysisThread(ctx, QUEUE_MS))
+    {
+        return;
+    }
+
+    vector<float> chunk(CHUNK_SIZE);
+    double ns;
+
+    feedSignal(signal, ctx, &chunk, &ns);
+
+    HowlLibStats stats;
+
+    getHowlLibStats(ctx, &stats);
+
+    printFeedLatency(signal, bufferMs, backend, "feed_async", stats);
+}
+
+int main(int argc, const char** argv)
+{
+    const int sampleRates[] = { 44100, 48000 };
+    const int bufferSizesMs[] = { 1000, 3000 };
+
+    struct { const char* _name; int _backend; } backends[] = {
+        { "cpu", HOWL_BACKEND_CPU },
+        { "fft", HOWL_BACKEND_FFT },
+#ifdef GPU_SUPPORT
+        { "af", HOWL_BACKEND_ARRAYFIRE },
+#endif
+    };
+
+    const int backendCount = sizeof(backends) / sizeof(backends[0]);
+
+    vector<BenchSignal> signals(2);
+
+    makeSynthetic(&signals[0], sampleRates[0]);
+    makeSynthetic(&signals[1], sampleRates[1]);
+
+    // test/howl dumps are 44100 Hz
+    if (argc > 2)
+    {
+        BenchSignal recorded;
+
+        if (loadBenchRecording(&recorded, argv[1], argv[2], 44100))
+        {
+            signals.push_back(recorded);
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s %s\n", argv[1], argv[2]);
+            return 1;
+        }
+    }
+
+    fprintf(stdout, "{\"benchmark\":\"pipeline\",\"chunk\":%d,\"results\":[\n", CHUNK_SIZE);
+
+    for (int s = 0; s < (int)signals.size(); ++s)
+    {
+        for (int m = 0; m < 2; ++m)
+        {
+            const int bufferMs = bufferSizesMs[m];
+
+            HowlLibContext* streamCtx = createBenchContext(signals[s]._sampleRate, bufferMs, HOWL_BACKEND_CPU);
+
+            if (!streamCtx)
+            {
+                fprintf(stderr, "cannot init %d Hz %d ms\n", signals[s]._sampleRate, bufferMs);
+                continue;
+            }
+
+            benchStreamStages(signals[s], bufferMs, streamCtx);
+
+            destroyHowlLibContext(streamCtx);
+
+            for (int b = 0; b < backendCount; ++b)
+            {
+                HowlLibContext* ctx = createBenchContext(signals[s]._sampleRate, bufferMs, backends[b]._backend);
+
+                if (!ctx)
+                {
+                    continue;
+                }
+
+                benchSnapshotStages(signals[s], bufferMs, ctx, backends[b]._name);
+
+                destroyHowlLibContext(ctx);
+
+                ctx = createBenchContext(signals[s]._sampleRate, bufferMs, backends[b]._backend);
+
+                if (!ctx)
+                {
+                    continue;
+                }
+
+                benchPipeline(signals[s], bufferMs, ctx, backends[b]._name);
+
+                destroyHowlLibContext(ctx);
+
+                ctx = createBenchContext(signals[s]._sampleRate, bufferMs, backends[b]._backend);
+
+                if (!ctx)
+                {
+                    continue;
+                }
+
+                benchAsyncFeed(signals[s], bufferMs, ctx, backends[b]._name);
+
+                destroyHowlLibContext(ctx);
+            }
+        }
+    }
+
+    fprintf(stdout, "\n]}\n");
+
+    return 0;
+}
@@ -0,0 +1,262 @@
+// pyramid.cpp
+// Checks that scoring pairs on the coarse pyramid first leaves every match
+// decision as it is at full resolution. Every pair is scored at full
+// resolution and on the coarse images of _pyramidLevels 2, decisions are
+// compared over a sweep of thresholds with the default margin, and real
+// pyramid runs are compared with the full resolution decisions.
+// Exits 1 on any difference.
+// ./pyramid [sourceraw captureraw] adds the recorded float32 dumps of test/howl.
+#include <HowlContext.h>
+#include "bench_signal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <chrono>
+#include <cmath>
+
+#define SAMPLE_RATE 44100
+#define BUFFER_MS 1000
+#define SIGNAL_SECONDS 12
+#define CHUNK_SIZE 4096
+#define BENCH_LEVELS 2
+
+using namespace std;
+
+// Scores of the pairs below 1, keyed by source and capture position
+typedef map<pair<long long, long long>, float> PairScores;
+
+static double nowNs()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Capture is the source played back 50ms later, attenuated, as in bench/pipeline
+static void makeLoop(BenchSignal* signal)
+{
+    signal->_name = "synthetic";
+    signal->_sampleRate = SAMPLE_RATE;
+
+    makeBenchTone(&signal->_source, SIGNAL_SECONDS * SAMPLE_RATE, SAMPLE_RATE, 1, 200.0);
+    makeBenchLoop(signal, SAMPLE_RATE / 20);
+}
+
+// Capture is other audio, every decision is a rejection
+static void makeUnrelated(BenchSignal* signal)
+{
+    signal->_name = "unrelated";
+    signal->_sampleRate = SAMPLE_RATE;
+
+    makeBenchTone(&signal->_source, SIGNAL_SECONDS * SAMPLE_RATE, SAMPLE_RATE, 1, 200.0);
+    makeBenchTone(&signal->_capture, SIGNAL_SECONDS * SAMPLE_RATE, SAMPLE_RATE, 7, 350.0);
+}
+
+static void matchDetected(void* userData, const HowlMatchEvent* event)
+{
+    PairScores* scores = (PairScores*)userData;
+
+    (*scores)[make_pair(event->_sourcePosition, event->_capturePosition)] = event->_score;
+}
+
+/**
+ * Feeds the signal and collects the score of every pair below threshold.
+ * A negative margin keeps the coarse score of every pair, it is only
+ * reachable here, the config rejects it.
+ */
+static bool runSignal(const BenchSignal& signal, int levels, float threshold, float margin, PairScores* scores, double* ms)
+{
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = HOWL_BACKEND_CPU;
+    config._matchThreshold = threshold;
+    config._pyramidLevels = levels;
+
+    HowlLibContext* ctx = createHowlLibContext();
+
+    if (!ctx || 0 != initHowlLibContextEx(ctx, SAMPLE_RATE, BUFFER_MS, NULL, &config))
+    {
+        destroyHowlLibContext(ctx);
+        return false;
+    }
+
+    ctx->_config._pyramidMargin = margin;
+
+    scores->clear();
+
+    setHowlLibMatchCallback(ctx, matchDetected, scores);
+
+    vector<float> chunk(CHUNK_SIZE);
+
+    const int total = (int)signal._source.size();
+    const double start = nowNs();
+
+    // Both streams in turn, as the offline runner feeds them
+    for (int offset = 0; offset < total; offset += CHUNK_SIZE)
+    {
+        const int count = total - offset < CHUNK_SIZE ? total - offset : CHUNK_SIZE;
+
+        copy(signal._source.begin() + offset, signal._source.begin() + offset + count, chunk.begin());
+        feedSourceAudio(ctx, &chunk.front(), count);
+
+        copy(signal._capture.begin() + offset, signal._capture.begin() + offset + count, chunk.begin());
+        feedCaptureAudio(ctx, &chunk.front(), count);
+    }
+
+    *ms = (nowNs() - start) / 1e6;
+
+    destroyHowlLibContext(ctx);
+
+    return true;
+}
+
+// Pairs not reported scored 1
+static float getPairScore(const PairScores& scores, const pair<long long, long long>& key)
+{
+    PairScores::const_iterator it = scores.find(key);
+
+    return it != scores.end() ? it->second : 1.0f;
+}
+
+// Pairs decided differently with the pyramid, as matchRenderPyramid decides them
+static int countDifferences(const PairScores& fine, const PairScores& coarse, float threshold, float margin)
+{
+    int differences = 0;
+
+    for (PairScores::const_iterator it = fine.begin(); it != fine.end(); ++it)
+    {
+        const bool bMatch = it->second < threshold;
+        const bool bPyramidMatch = getPairScore(coarse, it->first) < threshold + margin && bMatch;
+
+        differences += bMatch != bPyramidMatch ? 1 : 0;
+    }
+
+    return differences;
+}
+
+int main(int argc, const char** argv)
+{
+    HowlLibConfig defaults;
+
+    getHowlLibDefaultConfig(&defaults);
+
+    const float margin = defaults._pyramidMargin;
+
+    // The default, and one the loops here match at
+    const float checks[] = { defaults._matchThreshold, 0.97f };
+    const int checkCount = sizeof(checks) / sizeof(checks[0]);
+
+    vector<BenchSignal> signals(2);
+
+    makeLoop(&signals[0]);
+    makeUnrelated(&signals[1]);
+
+    // test/howl dumps are 44100 Hz
+    if (argc > 2)
+    {
+        BenchSignal recorded;
+
+        if (loadBenchRecording(&recorded, argv[1], argv[2], SAMPLE_RATE))
+        {
+            signals.push_back(recorded);
+        }
+        else
+        {
+            fprintf(stderr, "cannot read %s %s\n", argv[1], argv[2]);
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    bool bFirst = true;
+
+    fprintf(stdout, "{\"benchmark\":\"pyramid\",\"levels\":%d,\"margin\":%.3f,\"results\":[\n", BENCH_LEVELS, margin);
+
+    for (int s = 0; s < (int)signals.size(); ++s)
+    {
+        PairScores fine, coarse;
+        double fineMs, coarseMs;
+
+        // Threshold 1 reports every pair that has a peak
+        if (!runSignal(signals[s], 0, 1.0f, margin, &fine, &fineMs) ||
+            !runSignal(signals[s], BENCH_LEVELS, 1.0f, -1.0f, &coarse, &coarseMs))
+        {
+            fprintf(stderr, "cannot init %s\n", signals[s]._name);
+            return 1;
+        }
+
+        // How far a coarse score rose above its full resolution one, the margin has to cover it
+        float highest = -1.0f;
+        float lowestFine = 1.0f;
+
+        for (PairScores::const_iterator it = fine.begin(); it != fine.end(); ++it)
+        {
+            highest = max(highest, getPairScore(coarse, it->first) - it->second);
+            lowestFine = min(lowestFine, it->second);
+        }
+
+        int sweepDifferences = 0;
+
+        for (int t = 50; t < 100; ++t)
+        {
+            sweepDifferences += countDifferences(fine, coarse, t / 100.0f, margin);
+        }
+
+        failures += sweepDifferences;
+
+        for (int c = 0; c < checkCount; ++c)
+        {
+            PairScores pyramid;
+            double pyramidMs;
+
+            if (!runSignal(signals[s], BENCH_LEVELS, checks[c], margin, &pyramid, &pyramidMs))
+            {
+                fprintf(stderr, "cannot init %s\n", signals[s]._name);
+                return 1;
+            }
+
+            // The real pyramid path against the full resolution decisions
+            int matches = 0;
+            int differences = 0;
+
+            for (PairScores::const_iterator it = fine.begin(); it != fine.end(); ++it)
+            {
+                const bool bMatch = it->second < checks[c];
+
+                matches += bMatch ? 1 : 0;
+                differences += bMatch != (pyramid.count(it->first) > 0) ? 1 : 0;
+            }
+
+            for (PairScores::const_iterator it = pyramid.begin(); it != pyramid.end(); ++it)
+            {
+                differences += fine.count(it->first) == 0 ? 1 : 0;
+            }
+
+            failures += differences;
+
+            fprintf(stdout, "%s  {\"signal\":\"%s\",\"threshold\":%.2f,\"pairs\":%d,\"lowest_score\":%.4f,\"highest_coarse_minus_fine\":%.4f,"
+                            "\"sweep_differences\":%d,\"matches\":%d,\"pyramid_differences\":%d,\"ms\":%.1f,\"pyramid_ms\":%.1f}",
+                bFirst ? "" : ",\n",
+                signals[s]._name,
+                checks[c],
+                (int)fine.size(),
+                lowestFine,
+                highest,
+                sweepDifferences,
+                matches,
+                differences,
+                fineMs,
+                pyramidMs);
+
+            bFirst = false;
+        }
+    }
+
+    fprintf(stdout, "\n]}\n");
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+// ring_buffer.cpp
+// Compares the former std::deque<double> window path against AudioRing.
+#include <AudioRing.h>
+
+#include <stdio.h>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <cmath>
+
+#define BUFFER_MS 3000
+#define CHUNK_SIZE 4096
+#define SNAPSHOTS 64
+
+using namespace std;
+
+static double nowNs()
+{
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double benchDeque(const vector<float>& chunk, int bufferSize, int feeds, double* sink)
+{
+    deque<double> ring;
+    vector<double> window(bufferSize);
+
+    double start = nowNs();
+
+    for (int f = 0; f < feeds; ++f)
+    {
+        for (int i = 0; i < (int)chunk.size(); ++i)
+        {
+            if ((int)ring.size() >= bufferSize)
+            {
+                ring.pop_front();
+            }
+
+            ring.push_back(chunk[i]);
+        }
+
+        if ((int)ring.size() == bufferSize)
+        {
+            for (int i = 0; i < bufferSize; ++i)
+            {
+                window[i] = ring.at(i);
+            }
+
+            *sink += window[f % bufferSize];
+        }
+    }
+
+    return nowNs() - start;
+}
+
+static double benchAudioRing(const vector<float>& chunk, int bufferSize, int feeds, double* sink)
+{
+    AudioRing ring;
+
+    if (0 != initAudioRing(&ring, bufferSize))
+    {
+        return -1;
+    }
+
+    double start = nowNs();
+
+    for (int f = 0; f < feeds; ++f)
+    {
+        writeAudioRing(&ring, &chunk.front(), (int)chunk.size());
+
+        if (isAudioRingFull(&ring))
+        {
+            const double* window = getAudioRingWindow(&ring);
+
+            *sink += window[f % bufferSize];
+        }
+    }
+
+    double elapsed = nowNs() - start;
+
+    deinitAudioRing(&ring);
+
+    return elapsed;
+}
+
+int main(int argc, const char** argv)
+{
+    const int sampleRates[] = { 44100, 48000, 96000 };
+
+    vector<float> chunk(CHUNK_SIZE);
+
+    for (int i = 0; i < CHUNK_SIZE; ++i)
+    {
+        chunk[i] = sinf(2.0f * (float)M_PI * 440.0f * i / 44100.0f);
+    }
+
+    double sink = 0;
+
+    fprintf(stdout, "{\"benchmark\":\"ring_buffer\",\"buffer_ms\":%d,\"chunk\":%d,\"results\":[\n", BUFFER_MS, CHUNK_SIZE);
+
+    for (int r = 0; r < 3; ++r)
+    {
+        int bufferSize = BUFFER_MS * sampleRates[r] / 1000;
+        // Fill once, then take one snapshot per feed
+        int feeds = bufferSize / CHUNK_SIZE + SNAPSHOTS;
+        double samples = (double)feeds * CHUNK_SIZE;
+
+        double dequeNs = benchDeque(chunk, bufferSize, feeds, &sink);
+        double ringNs = benchAudioRing(chunk, bufferSize, feeds, &sink);
+
+        fprintf(stdout, "  {\"sample_rate\":%d,\"deque_ns_per_sample\":%.3f,\"ring_ns_per_sample\":%.3f,\"speedup\":%.1f}%s\n",
+            sampleRates[r],
+            dequeNs / samples,
+            ringNs / samples,
+            dequeNs / ringNs,
+            r < 2 ? "," : "");
+    }
+
+    fprintf(stdout, "]}\n");
+    fprintf(stderr, "sink %f\n", sink);
+
+    return 0;
+}
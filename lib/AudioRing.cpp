@@ -0,0 +1,139 @@
+// AudioRing.cpp
+#include "AudioRing.h"
+#include <new>
+#include <cstring>
+
+int initAudioRing(AudioRing* ring, int capacity)
+{
+    if (!ring || capacity <= 0)
+    {
+        return -1;
+    }
+
+    ring->_data = new(std::nothrow) double[2 * capacity];
+
+    if (!ring->_data)
+    {
+        return -1;
+    }
+
+    memset(ring->_data, 0, sizeof(double) * 2 * capacity);
+
+    ring->_capacity = capacity;
+    ring->_written.store(0, std::memory_order_relaxed);
+
+    return 0;
+}
+
+void deinitAudioRing(AudioRing* ring)
+{
+    if (!ring)
+    {
+        return;
+    }
+
+    delete [] ring->_data;
+
+    ring->_data = nullptr;
+    ring->_capacity = 0;
+}
+
+void writeAudioRing(AudioRing* ring, const float* samples, int samplesSize)
+{
+    const int capacity = ring->_capacity;
+    long long written = ring->_written.load(std::memory_order_relaxed);
+
+    // Only the last capacity samples can survive
+    if (samplesSize > capacity)
+    {
+        written += samplesSize - capacity;
+        samples += samplesSize - capacity;
+        samplesSize = capacity;
+    }
+
+    int pos = (int)(written % capacity);
+
+    while (samplesSize > 0)
+    {
+        int count = capacity - pos;
+
+        if (count > samplesSize)
+        {
+            count = samplesSize;
+        }
+
+        double* low = ring->_data + pos;
+        double* high = low + capacity;
+
+        for (int i = 0; i < count; ++i)
+        {
+            low[i] = high[i] = samples[i];
+        }
+
+        samples += count;
+        samplesSize -= count;
+        written += count;
+        pos = 0;
+    }
+
+    ring->_written.store(written, std::memory_order_release);
+}
+
+void writeAudioRingSilence(AudioRing* ring, long long samplesSize)
+{
+    const int capacity = ring->_capacity;
+    long long written = ring->_written.load(std::memory_order_relaxed);
+
+    if (samplesSize > capacity)
+    {
+        written += samplesSize - capacity;
+        samplesSize = capacity;
+    }
+
+    int pos = (int)(written % capacity);
+
+    while (samplesSize > 0)
+    {
+        const int count = capacity - pos < samplesSize ? capacity - pos : (int)samplesSize;
+
+        memset(ring->_data + pos, 0, sizeof(double) * count);
+        memset(ring->_data + pos + capacity, 0, sizeof(double) * count);
+
+        samplesSize -= count;
+        written += count;
+        pos = 0;
+    }
+
+    ring->_written.store(written, std::memory_order_release);
+}
+
+bool isAudioRingFull(const AudioRing* ring)
+{
+    return ring->_written.load(std::memory_order_acquire) >= ring->_capacity;
+}
+
+long long getAudioRingPosition(const AudioRing* ring)
+{
+    return ring->_written.load(std::memory_order_acquire);
+}
+
+double* getAudioRingWindow(const AudioRing* ring)
+{
+    long long written = ring->_written.load(std::memory_order_acquire);
+
+    return ring->_data + (int)(written % ring->_capacity);
+}
+
+const double* getAudioRingSamples(const AudioRing* ring, long long position, int count)
+{
+    long long written = ring->_written.load(std::memory_order_acquire);
+
+    if (position < 0 ||
+        position < written - ring->_capacity ||
+        position + count > written)
+    {
+        return nullptr;
+    }
+
+    return ring->_data + (int)(position % ring->_capacity);
+}
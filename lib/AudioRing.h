@@ -0,0 +1,38 @@
+// AudioRing.h
+#ifndef AUDIORING_H
+#define AUDIORING_H
+
+#include <atomic>
+
+/**
+ * Single producer / single consumer sample ring.
+ * Every sample is written twice (at i and i + capacity) so the
+ * most recent capacity samples are always one contiguous span.
+ */
+struct AudioRing
+{
+    double*                 _data;
+    int                     _capacity;
+    std::atomic<long long>  _written;
+};
+
+int initAudioRing(AudioRing* ring, int capacity);
+
+void deinitAudioRing(AudioRing* ring);
+
+void writeAudioRing(AudioRing* ring, const float* samples, int samplesSize);
+
+// Zeros for audio that was dropped, the position still counts it
+void writeAudioRingSilence(AudioRing* ring, long long samplesSize);
+
+bool isAudioRingFull(const AudioRing* ring);
+
+long long getAudioRingPosition(const AudioRing* ring);
+
+// Oldest sample of the current window, capacity samples are readable
+double* getAudioRingWindow(const AudioRing* ring);
+
+// count samples starting at stream position, NULL if not in the ring anymore
+const double* getAudioRingSamples(const AudioRing* ring, long long position, int count);
+
+#endif
@@ -0,0 +1,372 @@
+// CpuMatch.cpp
+#include "CpuMatch.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_MATCH_X86
+#include <immintrin.h>
+#endif
+
+// Sum of ((s - searchMean) - t)^2 over one template row, t is zero mean
+typedef float (*fpRowSsd)(const float* s, const float* t, int count, float searchMean);
+// Sum of s * t over one template row
+typedef float (*fpRowDot)(const float* s, const float* t, int count);
+
+static float rowSsdScalar(const float* s, const float* t, int count, float searchMean)
+{
+    float acc = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        float d = s[i] - searchMean - t[i];
+        acc += d * d;
+    }
+
+    return acc;
+}
+
+static float rowDotScalar(const float* s, const float* t, int count)
+{
+    float acc = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        acc += s[i] * t[i];
+    }
+
+    return acc;
+}
+
+#ifdef CPU_MATCH_X86
+
+__attribute__((target("avx2,fma")))
+static float rowSsdAvx2(const float* s, const float* t, int count, float searchMean)
+{
+    __m256 acc = _mm256_setzero_ps();
+    __m256 mean = _mm256_set1_ps(searchMean);
+
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 d = _mm256_sub_ps(_mm256_sub_ps(_mm256_loadu_ps(s + i), mean), _mm256_loadu_ps(t + i));
+        acc = _mm256_fmadd_ps(d, d, acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum) + rowSsdScalar(s + i, t + i, count - i, searchMean);
+}
+
+__attribute__((target("avx2,fma")))
+static float rowDotAvx2(const float* s, const float* t, int count)
+{
+    __m256 acc = _mm256_setzero_ps();
+
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(s + i), _mm256_loadu_ps(t + i), acc);
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum) + rowDotScalar(s + i, t + i, count - i);
+}
+
+__attribute__((target("avx512f")))
+static inline float sumAvx512(__m512 acc)
+{
+    float lanes[16];
+
+    _mm512_storeu_ps(lanes, acc);
+
+    float sum = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        sum += lanes[i];
+    }
+
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static float rowSsdAvx512(const float* s, const float* t, int count, float searchMean)
+{
+    __m512 acc = _mm512_setzero_ps();
+    __m512 mean = _mm512_set1_ps(searchMean);
+
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m512 d = _mm512_sub_ps(_mm512_sub_ps(_mm512_loadu_ps(s + i), mean), _mm512_loadu_ps(t + i));
+        acc = _mm512_fmadd_ps(d, d, acc);
+    }
+
+    return sumAvx512(acc) + rowSsdScalar(s + i, t + i, count - i, searchMean);
+}
+
+__attribute__((target("avx512f")))
+static float rowDotAvx512(const float* s, const float* t, int count)
+{
+    __m512 acc = _mm512_setzero_ps();
+
+    int i = 0;
+
+    for (; i + 16 <= count; i += 16)
+    {
+        acc = _mm512_fmadd_ps(_mm512_loadu_ps(s + i), _mm512_loadu_ps(t + i), acc);
+    }
+
+    return sumAvx512(acc) + rowDotScalar(s + i, t + i, count - i);
+}
+
+#endif
+
+struct CpuMatchKernels
+{
+    fpRowSsd        _rowSsd;
+    fpRowDot        _rowDot;
+    const char*     _isa;
+};
+
+static CpuMatchKernels resolveKernels()
+{
+    CpuMatchKernels kernels = { rowSsdScalar, rowDotScalar, "scalar" };
+
+#ifdef CPU_MATCH_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        kernels._rowSsd = rowSsdAvx512;
+        kernels._rowDot = rowDotAvx512;
+        kernels._isa = "avx512";
+    }
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        kernels._rowSsd = rowSsdAvx2;
+        kernels._rowDot = rowDotAvx2;
+        kernels._isa = "avx2";
+    }
+#endif
+
+    return kernels;
+}
+
+static const CpuMatchKernels& getKernels()
+{
+    static const CpuMatchKernels kernels = resolveKernels();
+
+    return kernels;
+}
+
+const char* getCpuMatchIsa()
+{
+    return getKernels()._isa;
+}
+
+int initCpuMatcher(
+    CpuMatcher* matcher,
+    int searchWidth,
+    int searchHeight,
+    int templateWidth,
+    int templateHeight)
+{
+    if (!matcher ||
+        searchWidth <= 0 || searchHeight <= 0 ||
+        templateWidth <= 0 || templateHeight <= 0)
+    {
+        return -1;
+    }
+
+    memset(matcher, 0, sizeof(CpuMatcher));
+
+    matcher->_searchWidth = searchWidth;
+    matcher->_searchHeight = searchHeight;
+    matcher->_templateWidth = templateWidth;
+    matcher->_templateHeight = templateHeight;
+    // Zero border so the kernels never branch on the image edge
+    matcher->_paddedWidth = searchWidth + templateWidth - 1;
+    matcher->_paddedHeight = searchHeight + templateHeight - 1;
+
+    const int paddedSize = matcher->_paddedWidth * matcher->_paddedHeight;
+    const int integralSize = (matcher->_paddedWidth + 1) * (matcher->_paddedHeight + 1);
+
+    matcher->_padded = new(std::nothrow) float[paddedSize];
+    matcher->_integral = new(std::nothrow) double[integralSize];
+    matcher->_integralSq = new(std::nothrow) double[integralSize];
+    matcher->_template = new(std::nothrow) float[templateWidth * templateHeight];
+    matcher->_result = new(std::nothrow) float[searchWidth * searchHeight];
+
+    if (!matcher->_padded ||
+        !matcher->_integral ||
+        !matcher->_integralSq ||
+        !matcher->_template ||
+        !matcher->_result)
+    {
+        deinitCpuMatcher(matcher);
+        return -1;
+    }
+
+    memset(matcher->_padded, 0, sizeof(float) * paddedSize);
+    memset(matcher->_integral, 0, sizeof(double) * integralSize);
+    memset(matcher->_integralSq, 0, sizeof(double) * integralSize);
+
+    getKernels();
+
+    return 0;
+}
+
+void deinitCpuMatcher(CpuMatcher* matcher)
+{
+    if (!matcher)
+    {
+        return;
+    }
+
+    delete [] matcher->_padded;
+    delete [] matcher->_integral;
+    delete [] matcher->_integralSq;
+    delete [] matcher->_template;
+    delete [] matcher->_result;
+
+    memset(matcher, 0, sizeof(CpuMatcher));
+}
+
+static inline float pixelAt(const void* pixels, bool bU8, int index)
+{
+    return bU8 ? (float)((const unsigned char*)pixels)[index] : ((const float*)pixels)[index];
+}
+
+void setCpuMatchSearch(CpuMatcher* matcher, const void* pixels, bool bU8)
+{
+    const int width = matcher->_searchWidth;
+    const int height = matcher->_searchHeight;
+    const int paddedWidth = matcher->_paddedWidth;
+    const int integralWidth = paddedWidth + 1;
+
+    for (int y = 0; y < height; ++y)
+    {
+        float* row = matcher->_padded + y * paddedWidth;
+
+        for (int x = 0; x < width; ++x)
+        {
+            row[x] = pixelAt(pixels, bU8, y * width + x);
+        }
+    }
+
+    // Integral images of the padded search, used for the window means
+    for (int y = 0; y < matcher->_paddedHeight; ++y)
+    {
+        const float* row = matcher->_padded + y * paddedWidth;
+        double* integral = matcher->_integral + (y + 1) * integralWidth;
+        double* integralSq = matcher->_integralSq + (y + 1) * integralWidth;
+
+        double rowSum = 0, rowSumSq = 0;
+
+        for (int x = 0; x < paddedWidth; ++x)
+        {
+            rowSum += row[x];
+            rowSumSq += (double)row[x] * row[x];
+
+            integral[x + 1] = integral[x + 1 - integralWidth] + rowSum;
+            integralSq[x + 1] = integralSq[x + 1 - integralWidth] + rowSumSq;
+        }
+    }
+}
+
+void setCpuMatchTemplate(CpuMatcher* matcher, const void* pixels, bool bU8)
+{
+    const int count = matcher->_templateWidth * matcher->_templateHeight;
+
+    double sum = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        sum += pixelAt(pixels, bU8, i);
+    }
+
+    const double mean = sum / count;
+
+    double sq = 0;
+
+    // Stored zero mean, ZSSD and ZNCC only need the centred template
+    for (int i = 0; i < count; ++i)
+    {
+        matcher->_template[i] = (float)(pixelAt(pixels, bU8, i) - mean);
+        sq += (double)matcher->_template[i] * matcher->_template[i];
+    }
+
+    matcher->_templateMean = mean;
+    matcher->_templateSq = sq;
+}
+
+static inline double windowSum(const double* integral, int integralWidth, int x, int y, int w, int h)
+{
+    return integral[(y + h) * integralWidth + x + w] -
+           integral[y * integralWidth + x + w] -
+           integral[(y + h) * integralWidth + x] +
+           integral[y * integralWidth + x];
+}
+
+void runCpuMatch(CpuMatcher* matcher, int metric)
+{
+    const CpuMatchKernels& kernels = getKernels();
+
+    const int tw = matcher->_templateWidth;
+    const int th = matcher->_templateHeight;
+    const int paddedWidth = matcher->_paddedWidth;
+    const int integralWidth = paddedWidth + 1;
+    const double count = (double)tw * th;
+
+    for (int y = 0; y < matcher->_searchHeight; ++y)
+    {
+        for (int x = 0; x < matcher->_searchWidth; ++x)
+        {
+            const float* search = matcher->_padded + y * paddedWidth + x;
+            const double sum = windowSum(matcher->_integral, integralWidth, x, y, tw, th);
+            const float mean = (float)(sum / count);
+
+            float value = 0;
+
+            if (metric == CPU_MATCH_ZNCC)
+            {
+                // Template is zero mean, so sum(s' * t') == sum(s * t')
+                double numerator = 0;
+
+                for (int ty = 0; ty < th; ++ty)
+                {
+                    numerator += kernels._rowDot(search + ty * paddedWidth, matcher->_template + ty * tw, tw);
+                }
+
+                double searchSq = windowSum(matcher->_integralSq, integralWidth, x, y, tw, th) - sum * sum / count;
+                double denominator = sqrt(searchSq * matcher->_templateSq);
+
+                value = denominator > 0 ? (float)(numerator / denominator) : 0.0f;
+            }
+            else
+            {
+                double disparity = 0;
+
+                for (int ty = 0; ty < th; ++ty)
+                {
+                    disparity += kernels._rowSsd(search + ty * paddedWidth, matcher->_template + ty * tw, tw, mean);
+                }
+
+                value = (float)disparity;
+            }
+
+            matcher->_result[y * matcher->_searchWidth + x] = value;
+        }
+    }
+}
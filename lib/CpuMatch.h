@@ -0,0 +1,50 @@
+// CpuMatch.h
+#ifndef CPUMATCH_H
+#define CPUMATCH_H
+
+#define CPU_MATCH_ZSSD 0
+#define CPU_MATCH_ZNCC 1
+
+/**
+ * Native template matcher, same convention as af::matchTemplate:
+ * result(x, y) compares the template anchored at (x, y) of the search
+ * image, search pixels outside the image count as zero.
+ * Kernels are picked once at runtime (AVX-512, AVX2 or scalar).
+ */
+struct CpuMatcher
+{
+    int             _searchWidth;
+    int             _searchHeight;
+    int             _templateWidth;
+    int             _templateHeight;
+    int             _paddedWidth;
+    int             _paddedHeight;
+    float*          _padded;
+    double*         _integral;
+    double*         _integralSq;
+    float*          _template;
+    double          _templateMean;
+    double          _templateSq;
+    float*          _result;
+};
+
+int initCpuMatcher(
+    CpuMatcher* matcher,
+    int searchWidth,
+    int searchHeight,
+    int templateWidth,
+    int templateHeight);
+
+void deinitCpuMatcher(CpuMatcher* matcher);
+
+// Row major pixels, u8 or float
+void setCpuMatchSearch(CpuMatcher* matcher, const void* pixels, bool bU8);
+
+void setCpuMatchTemplate(CpuMatcher* matcher, const void* pixels, bool bU8);
+
+// Fills _result (searchWidth x searchHeight, row major)
+void runCpuMatch(CpuMatcher* matcher, int metric);
+
+const char* getCpuMatchIsa();
+
+#endif
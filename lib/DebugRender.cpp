@@ -0,0 +1,68 @@
+// DebugRender.cpp
+#include "DebugRender.h"
+#include <new>
+
+#ifdef HOWL_DEBUG_RENDER
+
+#include <spectrogram.h>
+
+int writeDebugRender(
+    double* samples,
+    int samplesSize,
+    int sampleRate,
+    int width,
+    int height,
+    const char* pngPath)
+{
+    RENDER* render = new (std::nothrow) RENDER;
+
+    if (!render)
+    {
+        return -1;
+    }
+
+    if (0 != init_spectrogram(render))
+    {
+        delete render;
+        return -1;
+    }
+
+    render->pngfilepath = pngPath;
+
+    unsigned char* bitmapData = nullptr;
+
+    int ret = render_spectrogram_bitmap(
+        samples,
+        samplesSize,
+        sampleRate,
+        &bitmapData,
+        width,
+        height,
+        render,
+        0.0
+    );
+
+    // Path is owned by the caller
+    render->pngfilepath = nullptr;
+
+    deinit_spectrogram(render);
+
+    delete render;
+
+    return ret;
+}
+
+#else
+
+int writeDebugRender(
+    double*,
+    int,
+    int,
+    int,
+    int,
+    const char*)
+{
+    return -1;
+}
+
+#endif
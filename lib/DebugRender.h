@@ -0,0 +1,17 @@
+// DebugRender.h
+#ifndef DEBUGRENDER_H
+#define DEBUGRENDER_H
+
+/**
+ * Optional cairo/png sink of the analysed windows, compiled in with
+ * HOWL_DEBUG_RENDER. Not used by the detection itself.
+ */
+int writeDebugRender(
+    double* samples,
+    int samplesSize,
+    int sampleRate,
+    int width,
+    int height,
+    const char* pngPath);
+
+#endif
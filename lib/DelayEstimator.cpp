@@ -0,0 +1,178 @@
+// DelayEstimator.cpp
+#include "DelayEstimator.h"
+#include "FftPlan.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+int initDelayEstimator(DelayEstimator* estimator, int samples, int decimation)
+{
+    if (!estimator || decimation < 1 || samples < 2 * decimation)
+    {
+        return -1;
+    }
+
+    memset(estimator, 0, sizeof(DelayEstimator));
+
+    estimator->_samples = samples;
+    estimator->_decimation = decimation;
+    estimator->_length = samples / decimation;
+    // Zero padded to twice the window, no circular wrap of the correlation
+    estimator->_fftSize = getFftSizeForHop(estimator->_length);
+    estimator->_bins = estimator->_fftSize / 2 + 1;
+
+    estimator->_real = fftw_alloc_real(estimator->_fftSize);
+    estimator->_source = fftw_alloc_complex(estimator->_bins);
+    estimator->_capture = fftw_alloc_complex(estimator->_bins);
+
+    if (!estimator->_real || !estimator->_source || !estimator->_capture)
+    {
+        deinitDelayEstimator(estimator);
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        estimator->_forward = fftw_plan_dft_r2c_1d(
+            estimator->_fftSize,
+            estimator->_real,
+            estimator->_source,
+            FFTW_MEASURE);
+
+        estimator->_inverse = fftw_plan_dft_c2r_1d(
+            estimator->_fftSize,
+            estimator->_capture,
+            estimator->_real,
+            FFTW_MEASURE);
+    }
+
+    if (!estimator->_forward || !estimator->_inverse)
+    {
+        deinitDelayEstimator(estimator);
+        return -1;
+    }
+
+    return 0;
+}
+
+void deinitDelayEstimator(DelayEstimator* estimator)
+{
+    if (!estimator)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        if (estimator->_forward)
+        {
+            fftw_destroy_plan(estimator->_forward);
+        }
+
+        if (estimator->_inverse)
+        {
+            fftw_destroy_plan(estimator->_inverse);
+        }
+    }
+
+    if (estimator->_real)
+    {
+        fftw_free(estimator->_real);
+    }
+
+    if (estimator->_source)
+    {
+        fftw_free(estimator->_source);
+    }
+
+    if (estimator->_capture)
+    {
+        fftw_free(estimator->_capture);
+    }
+
+    memset(estimator, 0, sizeof(DelayEstimator));
+}
+
+void decimateDelayWindow(const DelayEstimator* estimator, const double* samples, double* window)
+{
+    const int decimation = estimator->_decimation;
+    const double scale = 1.0 / decimation;
+
+    // Most recent samples kept when the window does not divide evenly
+    samples += estimator->_samples - estimator->_length * decimation;
+
+    for (int i = 0; i < estimator->_length; ++i)
+    {
+        double sum = 0.0;
+
+        for (int k = 0; k < decimation; ++k)
+        {
+            sum += samples[i * decimation + k];
+        }
+
+        window[i] = sum * scale;
+    }
+}
+
+static void transformWindow(DelayEstimator* estimator, const double* window, fftw_complex* spectrum)
+{
+    memcpy(estimator->_real, window, sizeof(double) * estimator->_length);
+    memset(estimator->_real + estimator->_length, 0, sizeof(double) * (estimator->_fftSize - estimator->_length));
+
+    fftw_execute_dft_r2c(estimator->_forward, estimator->_real, spectrum);
+}
+
+float estimateDelay(DelayEstimator* estimator, const double* sourceWindow, const double* captureWindow, int minLag, int maxLag, int* lag)
+{
+    const int half = estimator->_length / 2;
+
+    minLag = minLag < -half ? -half : minLag;
+    maxLag = maxLag > half ? half : maxLag;
+
+    *lag = 0;
+
+    if (minLag > maxLag)
+    {
+        return 0.0f;
+    }
+
+    transformWindow(estimator, sourceWindow, estimator->_source);
+    transformWindow(estimator, captureWindow, estimator->_capture);
+
+    fftw_complex* source = estimator->_source;
+    fftw_complex* cross = estimator->_capture;
+
+    // Capture times conj(source), whitened
+    for (int i = 0; i < estimator->_bins; ++i)
+    {
+        const double re = cross[i][0] * source[i][0] + cross[i][1] * source[i][1];
+        const double im = cross[i][1] * source[i][0] - cross[i][0] * source[i][1];
+        const double magnitude = sqrt(re * re + im * im);
+
+        cross[i][0] = magnitude > 1e-20 ? re / magnitude : 0.0;
+        cross[i][1] = magnitude > 1e-20 ? im / magnitude : 0.0;
+    }
+
+    fftw_execute_dft_c2r(estimator->_inverse, cross, estimator->_real);
+
+    const int size = estimator->_fftSize;
+
+    double best = -1.0;
+
+    // Negative lags wrapped to the end
+    for (int k = minLag; k <= maxLag; ++k)
+    {
+        const double value = estimator->_real[k >= 0 ? k : size + k];
+
+        if (value > best)
+        {
+            best = value;
+            *lag = k;
+        }
+    }
+
+    // An unnormalized inverse of unit bins peaks at the transform size
+    return (float)(best / size);
+}
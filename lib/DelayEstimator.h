@@ -0,0 +1,42 @@
+// DelayEstimator.h
+#ifndef DELAYESTIMATOR_H
+#define DELAYESTIMATOR_H
+
+#include <fftw3.h>
+
+/**
+ * Generalized cross-correlation with phase transform (GCC-PHAT) between
+ * a source and a capture window of the same length. Windows are box
+ * decimated first, the cross spectrum is whitened so only phase counts,
+ * and the inverse transform peaks at the delay of the capture. The peak
+ * is 1 for a pure delay and near 0 without a coherent path.
+ */
+struct DelayEstimator
+{
+    int             _samples; // Input samples per window
+    int             _decimation;
+    int             _length; // Decimated samples per window
+    int             _fftSize;
+    int             _bins;
+    fftw_plan       _forward;
+    fftw_plan       _inverse;
+    double*         _real;
+    fftw_complex*   _source;
+    fftw_complex*   _capture;
+};
+
+int initDelayEstimator(DelayEstimator* estimator, int samples, int decimation);
+
+void deinitDelayEstimator(DelayEstimator* estimator);
+
+// _samples samples into _length
+void decimateDelayWindow(const DelayEstimator* estimator, const double* samples, double* window);
+
+/**
+ * Delay of the capture window behind the source window, in decimated
+ * samples between minLag and maxLag (clamped to half a window either
+ * way). Returns the coherence of that delay.
+ */
+float estimateDelay(DelayEstimator* estimator, const double* sourceWindow, const double* captureWindow, int minLag, int maxLag, int* lag);
+
+#endif
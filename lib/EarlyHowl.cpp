@@ -0,0 +1,112 @@
+// EarlyHowl.cpp
+#include "HowlContext.h"
+#include <new>
+
+EarlyHowl* createEarlyHowl(HowlLibContext* ctx)
+{
+    const StftStream* stft = ctx->_capture._stft;
+
+    EarlyHowl* earlyHowl = new(std::nothrow) EarlyHowl();
+
+    if (!earlyHowl)
+    {
+        return nullptr;
+    }
+
+    // Whole columns, a run never detects before _howlPersistenceMs
+    const long long persistence = (long long)ctx->_config._howlPersistenceMs * ctx->_sampleRate / 1000;
+    const int frames = (int)((persistence + stft->_hopSize - 1) / stft->_hopSize);
+
+    earlyHowl->_binHz = (float)ctx->_sampleRate / stft->_plan->_size;
+    earlyHowl->_lastDetection = -1;
+
+    if (0 != initHowlDetector(&earlyHowl->_detector,
+                              stft->_bins,
+                              ctx->_config._howlPaprDb,
+                              ctx->_config._howlPhprDb,
+                              frames > 0 ? frames : 1))
+    {
+        delete earlyHowl;
+        return nullptr;
+    }
+
+    return earlyHowl;
+}
+
+void destroyEarlyHowl(EarlyHowl* earlyHowl)
+{
+    if (!earlyHowl)
+    {
+        return;
+    }
+
+    deinitHowlDetector(&earlyHowl->_detector);
+
+    delete earlyHowl;
+}
+
+void trackEarlyHowl(HowlLibContext* ctx, HowlStream* stream, int columns)
+{
+    EarlyHowl* earlyHowl = ctx->_earlyHowl;
+    const StftStream* stft = stream->_stft;
+
+    columns = columns < stft->_frames ? columns : stft->_frames;
+
+    if (columns <= 0)
+    {
+        return;
+    }
+
+    const long long trace = beginHowlTrace();
+
+    const float* column = getStftNewestColumns(stft, columns);
+
+    for (int i = 0; i < columns; ++i, column += stft->_bins)
+    {
+        const int found = updateHowlDetector(&earlyHowl->_detector, column, earlyHowl->_detections, EARLY_HOWL_DETECTIONS);
+
+        // End of this column's frame, the stft is already past the newest one
+        const long long position = stft->_nextFrameEnd - (long long)(columns - i) * stft->_hopSize;
+
+        // Refreshed while a detected tone lasts, so every window of a sustained howl can confirm it
+        if (earlyHowl->_detector._active > 0)
+        {
+            earlyHowl->_lastDetection = position;
+        }
+
+        if (found == 0)
+        {
+            continue;
+        }
+
+        ctx->_stats._earlyDetections.fetch_add(found, std::memory_order_relaxed);
+
+        if (ctx->_earlyCb == NULL)
+        {
+            continue;
+        }
+
+        for (int k = 0; k < found && k < EARLY_HOWL_DETECTIONS; ++k)
+        {
+            const HowlDetection& detection = earlyHowl->_detections[k];
+
+            HowlEarlyEvent event;
+
+            event._capturePosition = position;
+            event._frequencyHz = detection._bin * earlyHowl->_binHz;
+            event._paprDb = detection._paprDb;
+            event._phprDb = detection._phprDb;
+
+            (*ctx->_earlyCb)(ctx->_earlyCbData, &event);
+        }
+    }
+
+    endHowlTrace("early_howl", trace);
+}
+
+bool hasEarlyHowl(HowlLibContext* ctx, HowlStream* stream)
+{
+    const long long last = ctx->_earlyHowl->_lastDetection;
+
+    return last >= 0 && getAudioRingPosition(stream->_ringBuffer) - last < ctx->_bufferSize;
+}
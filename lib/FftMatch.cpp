@@ -0,0 +1,308 @@
+// FftMatch.cpp
+#include "FftMatch.h"
+#include "FftPlan.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+// Smallest size >= value with only 2, 3, 5 and 7 as factors (fast in fftw)
+static int goodFftSize(int value)
+{
+    for (int size = value; ; ++size)
+    {
+        int rest = size;
+
+        const int factors[] = { 2, 3, 5, 7 };
+
+        for (int i = 0; i < 4; ++i)
+        {
+            while (rest % factors[i] == 0)
+            {
+                rest /= factors[i];
+            }
+        }
+
+        if (rest == 1)
+        {
+            return size;
+        }
+    }
+}
+
+int initFftMatcher(FftMatcher* matcher, int width, int height)
+{
+    if (!matcher || width <= 0 || height <= 0)
+    {
+        return -1;
+    }
+
+    memset(matcher, 0, sizeof(FftMatcher));
+
+    matcher->_width = width;
+    matcher->_height = height;
+    // Linear correlation of every anchor, no circular wrap
+    matcher->_fftWidth = goodFftSize(2 * width - 1);
+    matcher->_fftHeight = goodFftSize(2 * height - 1);
+    matcher->_bins = matcher->_fftHeight * (matcher->_fftWidth / 2 + 1);
+
+    matcher->_real = fftw_alloc_real(matcher->_fftWidth * matcher->_fftHeight);
+    matcher->_product = fftw_alloc_complex(matcher->_bins);
+    matcher->_result = new(std::nothrow) float[width * height];
+
+    if (!matcher->_real || !matcher->_product || !matcher->_result)
+    {
+        deinitFftMatcher(matcher);
+        return -1;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        matcher->_forward = fftw_plan_dft_r2c_2d(
+            matcher->_fftHeight,
+            matcher->_fftWidth,
+            matcher->_real,
+            matcher->_product,
+            FFTW_MEASURE);
+
+        matcher->_inverse = fftw_plan_dft_c2r_2d(
+            matcher->_fftHeight,
+            matcher->_fftWidth,
+            matcher->_product,
+            matcher->_real,
+            FFTW_MEASURE);
+    }
+
+    if (!matcher->_forward || !matcher->_inverse)
+    {
+        deinitFftMatcher(matcher);
+        return -1;
+    }
+
+    return 0;
+}
+
+void deinitFftMatcher(FftMatcher* matcher)
+{
+    if (!matcher)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        if (matcher->_forward)
+        {
+            fftw_destroy_plan(matcher->_forward);
+        }
+
+        if (matcher->_inverse)
+        {
+            fftw_destroy_plan(matcher->_inverse);
+        }
+    }
+
+    if (matcher->_real)
+    {
+        fftw_free(matcher->_real);
+    }
+
+    if (matcher->_product)
+    {
+        fftw_free(matcher->_product);
+    }
+
+    delete [] matcher->_result;
+
+    memset(matcher, 0, sizeof(FftMatcher));
+}
+
+FftMatchOperand* createFftMatchOperand(const FftMatcher* matcher)
+{
+    FftMatchOperand* operand = new(std::nothrow) FftMatchOperand;
+
+    if (!operand)
+    {
+        return nullptr;
+    }
+
+    const int integralSize = (matcher->_width + 1) * (matcher->_height + 1);
+
+    operand->_spectrum = fftw_alloc_complex(matcher->_bins);
+    operand->_integral = new(std::nothrow) double[integralSize];
+    operand->_integralSq = new(std::nothrow) double[integralSize];
+    operand->_sq = 0;
+
+    if (!operand->_spectrum || !operand->_integral || !operand->_integralSq)
+    {
+        destroyFftMatchOperand(operand);
+        return nullptr;
+    }
+
+    memset(operand->_integral, 0, sizeof(double) * integralSize);
+    memset(operand->_integralSq, 0, sizeof(double) * integralSize);
+
+    return operand;
+}
+
+void destroyFftMatchOperand(FftMatchOperand* operand)
+{
+    if (!operand)
+    {
+        return;
+    }
+
+    if (operand->_spectrum)
+    {
+        fftw_free(operand->_spectrum);
+    }
+
+    delete [] operand->_integral;
+    delete [] operand->_integralSq;
+
+    delete operand;
+}
+
+static inline double pixelAt(const void* pixels, bool bU8, int index)
+{
+    return bU8 ? (double)((const unsigned char*)pixels)[index] : (double)((const float*)pixels)[index];
+}
+
+static void transformPadded(FftMatcher* matcher, fftw_complex* spectrum)
+{
+    fftw_execute_dft_r2c(matcher->_forward, matcher->_real, spectrum);
+}
+
+void prepareFftSearch(FftMatcher* matcher, FftMatchOperand* search, const void* pixels, bool bU8)
+{
+    const int width = matcher->_width;
+    const int height = matcher->_height;
+    const int integralWidth = width + 1;
+
+    memset(matcher->_real, 0, sizeof(double) * matcher->_fftWidth * matcher->_fftHeight);
+
+    for (int y = 0; y < height; ++y)
+    {
+        double* row = matcher->_real + y * matcher->_fftWidth;
+        double* integral = search->_integral + (y + 1) * integralWidth;
+        double* integralSq = search->_integralSq + (y + 1) * integralWidth;
+
+        double rowSum = 0, rowSumSq = 0;
+
+        for (int x = 0; x < width; ++x)
+        {
+            const double value = pixelAt(pixels, bU8, y * width + x);
+
+            row[x] = value;
+
+            rowSum += value;
+            rowSumSq += value * value;
+
+            integral[x + 1] = integral[x + 1 - integralWidth] + rowSum;
+            integralSq[x + 1] = integralSq[x + 1 - integralWidth] + rowSumSq;
+        }
+    }
+
+    transformPadded(matcher, search->_spectrum);
+}
+
+void prepareFftTemplate(FftMatcher* matcher, FftMatchOperand* tmpl, const void* pixels, bool bU8)
+{
+    const int width = matcher->_width;
+    const int height = matcher->_height;
+    const int count = width * height;
+
+    double sum = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        sum += pixelAt(pixels, bU8, i);
+    }
+
+    const double mean = sum / count;
+
+    memset(matcher->_real, 0, sizeof(double) * matcher->_fftWidth * matcher->_fftHeight);
+
+    double sq = 0;
+
+    // Centred template, its window sums are not needed
+    for (int y = 0; y < height; ++y)
+    {
+        double* row = matcher->_real + y * matcher->_fftWidth;
+
+        for (int x = 0; x < width; ++x)
+        {
+            const double value = pixelAt(pixels, bU8, y * width + x) - mean;
+
+            row[x] = value;
+            sq += value * value;
+        }
+    }
+
+    tmpl->_sq = sq;
+
+    transformPadded(matcher, tmpl->_spectrum);
+}
+
+static inline double windowSum(const double* integral, int integralWidth, int x0, int y0, int x1, int y1)
+{
+    return integral[y1 * integralWidth + x1] -
+           integral[y0 * integralWidth + x1] -
+           integral[y1 * integralWidth + x0] +
+           integral[y0 * integralWidth + x0];
+}
+
+void runFftMatch(FftMatcher* matcher, const FftMatchOperand* search, const FftMatchOperand* tmpl, int metric)
+{
+    const int width = matcher->_width;
+    const int height = matcher->_height;
+    const int integralWidth = width + 1;
+    const double count = (double)width * height;
+    const double scale = 1.0 / ((double)matcher->_fftWidth * matcher->_fftHeight);
+
+    // Correlation: S * conj(T)
+    for (int i = 0; i < matcher->_bins; ++i)
+    {
+        const double sr = search->_spectrum[i][0];
+        const double si = search->_spectrum[i][1];
+        const double tr = tmpl->_spectrum[i][0];
+        const double ti = tmpl->_spectrum[i][1];
+
+        matcher->_product[i][0] = sr * tr + si * ti;
+        matcher->_product[i][1] = si * tr - sr * ti;
+    }
+
+    fftw_execute_dft_c2r(matcher->_inverse, matcher->_product, matcher->_real);
+
+    for (int y = 0; y < height; ++y)
+    {
+        const double* cross = matcher->_real + y * matcher->_fftWidth;
+
+        for (int x = 0; x < width; ++x)
+        {
+            // Template is as large as the image, so the window always clips
+            // at the bottom right corner, outside pixels are zero
+            const double sum = windowSum(search->_integral, integralWidth, x, y, width, height);
+            const double sumSq = windowSum(search->_integralSq, integralWidth, x, y, width, height);
+            const double searchSq = sumSq - sum * sum / count;
+            // Template is zero mean, so sum(s' * t') == sum(s * t')
+            const double numerator = cross[x] * scale;
+
+            float value = 0;
+
+            if (metric == FFT_MATCH_ZNCC)
+            {
+                const double denominator = sqrt(searchSq * tmpl->_sq);
+
+                value = denominator > 0 ? (float)(numerator / denominator) : 0.0f;
+            }
+            else
+            {
+                value = (float)(searchSq - 2.0 * numerator + tmpl->_sq);
+            }
+
+            matcher->_result[y * width + x] = value;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+// FftMatch.h
+#ifndef FFTMATCH_H
+#define FFTMATCH_H
+
+#include <fftw3.h>
+
+#define FFT_MATCH_ZSSD 0
+#define FFT_MATCH_ZNCC 1
+
+/**
+ * Frequency domain template matcher producing the same ZSSD/ZNCC surface
+ * as CpuMatch/af::matchTemplate. The cross term comes from one inverse
+ * transform of S * conj(T), window sums from integral images.
+ * Operands are transformed once and can be reused against any number of
+ * partners (source template against every capture and vice versa).
+ */
+struct FftMatcher
+{
+    int             _width;
+    int             _height;
+    int             _fftWidth;
+    int             _fftHeight;
+    int             _bins;
+    fftw_plan       _forward;
+    fftw_plan       _inverse;
+    double*         _real;
+    fftw_complex*   _product;
+    float*          _result;
+};
+
+struct FftMatchOperand
+{
+    fftw_complex*   _spectrum;
+    double*         _integral;
+    double*         _integralSq;
+    double          _sq;
+};
+
+int initFftMatcher(FftMatcher* matcher, int width, int height);
+
+void deinitFftMatcher(FftMatcher* matcher);
+
+FftMatchOperand* createFftMatchOperand(const FftMatcher* matcher);
+
+void destroyFftMatchOperand(FftMatchOperand* operand);
+
+// Row major pixels, u8 or float
+void prepareFftSearch(FftMatcher* matcher, FftMatchOperand* search, const void* pixels, bool bU8);
+
+void prepareFftTemplate(FftMatcher* matcher, FftMatchOperand* tmpl, const void* pixels, bool bU8);
+
+// Fills _result (width x height, row major)
+void runFftMatch(FftMatcher* matcher, const FftMatchOperand* search, const FftMatchOperand* tmpl, int metric);
+
+#endif
@@ -0,0 +1,130 @@
+// FftPlan.cpp
+#include "FftPlan.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+std::mutex& getFftPlannerMutex()
+{
+    static std::mutex mutex;
+
+    return mutex;
+}
+
+int getFftSizeForHop(int hopSize)
+{
+    int size = 1;
+
+    while (size < 2 * hopSize)
+    {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+int initFftPlan(FftPlan* plan, int size)
+{
+    if (!plan || size <= 0)
+    {
+        return -1;
+    }
+
+    memset(plan, 0, sizeof(FftPlan));
+
+    plan->_size = size;
+    plan->_bins = size / 2 + 1;
+    plan->_window = new(std::nothrow) double[size];
+
+    double* input = nullptr;
+    fftw_complex* output = nullptr;
+
+    if (!plan->_window ||
+        0 != allocFftWorkspace(plan, &input, &output))
+    {
+        deinitFftPlan(plan);
+        return -1;
+    }
+
+    // Hann
+    for (int i = 0; i < size; ++i)
+    {
+        plan->_window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / size);
+    }
+
+    // Paid once per context, so measure instead of estimate
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        plan->_plan = fftw_plan_dft_r2c_1d(
+            size,
+            input,
+            output,
+            FFTW_MEASURE);
+    }
+
+    freeFftWorkspace(input, output);
+
+    if (!plan->_plan)
+    {
+        deinitFftPlan(plan);
+        return -1;
+    }
+
+    return 0;
+}
+
+void deinitFftPlan(FftPlan* plan)
+{
+    if (!plan)
+    {
+        return;
+    }
+
+    if (plan->_plan)
+    {
+        std::lock_guard<std::mutex> lock(getFftPlannerMutex());
+
+        fftw_destroy_plan(plan->_plan);
+    }
+
+    delete [] plan->_window;
+
+    memset(plan, 0, sizeof(FftPlan));
+}
+
+int allocFftWorkspace(const FftPlan* plan, double** input, fftw_complex** output)
+{
+    *input = fftw_alloc_real(plan->_size);
+    *output = fftw_alloc_complex(plan->_bins);
+
+    if (!*input || !*output)
+    {
+        freeFftWorkspace(*input, *output);
+
+        *input = nullptr;
+        *output = nullptr;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void freeFftWorkspace(double* input, fftw_complex* output)
+{
+    if (input)
+    {
+        fftw_free(input);
+    }
+
+    if (output)
+    {
+        fftw_free(output);
+    }
+}
+
+void executeFftPlan(const FftPlan* plan, double* input, fftw_complex* output)
+{
+    fftw_execute_dft_r2c(plan->_plan, input, output);
+}
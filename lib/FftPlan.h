@@ -0,0 +1,39 @@
+// FftPlan.h
+#ifndef FFTPLAN_H
+#define FFTPLAN_H
+
+#include <fftw3.h>
+#include <mutex>
+
+/**
+ * Real to complex transform planned once per context.
+ * Plans are executed with the new-array interface so every stream keeps
+ * its own fftw_malloc'd (SIMD aligned) workspace and the plan and window
+ * table can be shared read-only between threads.
+ */
+struct FftPlan
+{
+    int             _size;
+    int             _bins;
+    fftw_plan       _plan;
+    double*         _window;
+};
+
+// Held around every fftw plan create and destroy, fftw's planner is not thread-safe
+std::mutex& getFftPlannerMutex();
+
+// Smallest transform giving at least 50% overlap for hopSize
+int getFftSizeForHop(int hopSize);
+
+int initFftPlan(FftPlan* plan, int size);
+
+void deinitFftPlan(FftPlan* plan);
+
+// Aligned input/output pair usable with plan
+int allocFftWorkspace(const FftPlan* plan, double** input, fftw_complex** output);
+
+void freeFftWorkspace(double* input, fftw_complex* output);
+
+void executeFftPlan(const FftPlan* plan, double* input, fftw_complex* output);
+
+#endif
@@ -0,0 +1,453 @@
+// HowlContext.h
+// Internal state shared between the libhowl sources, not part of the api
+
+#ifndef HOWLCONTEXT_H
+#define HOWLCONTEXT_H
+
+#include "howl.h"
+#include "AudioRing.h"
+#include "FftPlan.h"
+#include "Stft.h"
+#include "CpuMatch.h"
+#include "FftMatch.h"
+#include "DelayEstimator.h"
+#include "Landmark.h"
+#include "HowlDetector.h"
+#include "SampleQueue.h"
+#include "WorkPool.h"
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// Defaults of HowlLibConfig
+#define SPECTROGRAM_WIDTH 250//500
+#define SPECTROGRAM_HEIGHT 128//256
+#define OVERLAP_PERCENTAGE 50
+#define SILENCE_THRESHOLD 10.0
+#define MAX_SPECTROGRAMS 1
+#define SPECTROGRAM_RANGE_DB 80.0f
+#define MATCH_THRESHOLD 0.75f
+#define PYRAMID_LEVELS 0
+#define PYRAMID_MARGIN 0.1f
+#define MIN_LAG_MS 0
+#define MAX_LAG_MS 0
+#define DELAY_TRACKING 0
+#define DELAY_COHERENCE 0.1f
+#define HOWL_DETECTION HOWL_DETECTION_OFF
+#define HOWL_PAPR_DB 20.0f
+#define HOWL_PHPR_DB 10.0f
+#define HOWL_PERSISTENCE_MS 60
+
+// Feeds remembered per stream to date the samples of a render
+#define ARRIVAL_STAMPS 256
+
+#define SPECTROGRAM_FORMAT_F32 0
+#define SPECTROGRAM_FORMAT_U8 1
+#define SPECTROGRAM_FORMAT SPECTROGRAM_FORMAT_U8
+
+struct RenderPool;
+
+// Immutable once published, shared by reference count
+struct SpectrumRender
+{
+    unsigned char*          _image;
+    int                     _format;
+    int                     _width;
+    int                     _height;
+    long long               _position; // Stream sample position at the end of the window
+    int                     _index;
+    FftMatchOperand*        _fftOperand; // Kept across reuse, prepareRender overwrites it
+    float*                  _coarse; // Box filtered image for _pyramidLevels, kept across reuse like _fftOperand
+    std::atomic<int>        _refs;
+    RenderPool*             _pool; // Returned there on the last release, NULL frees
+    SpectrumRender*         _nextFree;
+};
+
+/**
+ * Ring of the last _maxSpectrograms renders of a stream. Positions grow
+ * from the oldest to the newest, so the renders of a position range are
+ * found by binary search.
+ */
+struct RenderHistory
+{
+    SpectrumRender**        _renders;
+    int                     _capacity;
+    int                     _head; // Oldest
+    int                     _count;
+};
+
+/**
+ * Renders of one context and their images and fft operands are recycled
+ * instead of freed. The pool only grows while the number of renders alive
+ * at once grows, so steady state snapshots do not allocate.
+ */
+struct RenderPool
+{
+    std::mutex              _mutex;
+    SpectrumRender*         _free;
+    int                     _width;
+    int                     _height;
+    int                     _format;
+    int                     _size;
+};
+
+struct StatsHistogram
+{
+    std::atomic<long long>  _count;
+    std::atomic<long long>  _totalUs;
+    std::atomic<long long>  _maxUs;
+    std::atomic<long long>  _buckets[HOWL_STATS_BUCKETS];
+};
+
+// Relaxed atomics, updated from the feeding and analysis threads
+struct HowlStats
+{
+    std::atomic<long long>  _sourceSamples;
+    std::atomic<long long>  _captureSamples;
+    std::atomic<long long>  _droppedSamples;
+    std::atomic<long long>  _lateSamples;
+    std::atomic<long long>  _snapshots;
+    std::atomic<long long>  _silentSnapshots;
+    std::atomic<long long>  _pairsScored;
+    std::atomic<long long>  _pairsSkipped;
+    std::atomic<long long>  _pairsCoarse;
+    std::atomic<long long>  _matches;
+    std::atomic<long long>  _errors;
+    std::atomic<long long>  _incoherentSnapshots;
+    std::atomic<long long>  _landmarks;
+    std::atomic<long long>  _earlyDetections;
+    std::atomic<long long>  _unflaggedSnapshots;
+    StatsHistogram          _spectrogram;
+    StatsHistogram          _matching;
+    StatsHistogram          _peaks;
+    StatsHistogram          _detection;
+    StatsHistogram          _feed;
+};
+
+struct ArrivalStamp
+{
+    std::atomic<long long>  _end; // Samples fed once this feed was accepted
+    std::atomic<long long>  _timeNs;
+};
+
+/**
+ * Single producer / single consumer: the feeding thread stamps every
+ * accepted feed, analysis looks up the feed of a render's last sample.
+ */
+struct StreamArrivals
+{
+    ArrivalStamp            _stamps[ARRIVAL_STAMPS];
+    std::atomic<long long>  _count;
+    long long               _fed; // Feeding thread only
+    long long               _read; // Analysis only
+};
+
+// Matcher scratch, one per thread that runs checkAllRenders
+struct PeakWorkspace;
+
+struct MatchWorkspace
+{
+    CpuMatcher*                     _cpuMatcher;
+    FftMatcher*                     _fftMatcher;
+    std::vector<float>*             _surface;
+    std::vector<SpectrumRender*>*   _snapshot;
+    std::vector<SpectrumRender*>*   _batchSources;
+    std::vector<SpectrumRender*>*   _batchCaptures;
+    std::vector<float>*             _batchScores;
+    std::vector<unsigned char>*     _batchPixels;
+    std::vector<float>*             _batchSurfaces;
+    std::vector<unsigned int>*      _batchIndices;
+    PeakWorkspace*                  _peaks;
+    CpuMatcher*                     _coarseMatcher; // Coarse pyramid level, any backend
+    std::vector<SpectrumRender*>*   _fineSources; // Pairs the coarse level could not reject
+    std::vector<SpectrumRender*>*   _fineCaptures;
+    std::vector<float>*             _fineScores;
+    std::vector<int>*               _fineIndices;
+};
+
+// Only the thread feeding the stream touches it, except _renders which is guarded by the context
+struct HowlStream
+{
+    const char*             _name;
+    AudioRing*              _ringBuffer;
+    StftStream*             _stft;
+    long long               _nextSnapshot;
+    double                  _triggerRender;
+    int                     _renderCount;
+    RenderHistory*          _renders;
+    MatchWorkspace*         _workspace;
+    StreamArrivals*         _arrivals;
+    long long               _stftNs; // Since the last snapshot
+};
+
+/**
+ * Loop delay tracking. Every source snapshot publishes its decimated
+ * window, every capture snapshot correlates its own window with it.
+ */
+struct LoopDelay
+{
+    std::mutex              _mutex; // _sourceWindow and _sourcePosition
+    double*                 _sourceWindow;
+    long long               _sourcePosition; // -1 before the first source window
+    DelayEstimator          _estimator; // Capture side only, like the two windows below
+    double*                 _sourceCopy;
+    double*                 _captureWindow;
+    std::atomic<long long>  _delay; // Latest coherent estimate, LLONG_MIN when there is none
+    std::atomic<long long>  _estimate;
+    std::atomic<float>      _coherence;
+};
+
+/**
+ * HOWL_BACKEND_LANDMARK state. Source windows add their landmarks to the
+ * index, capture windows look theirs up and vote on the lag to the source.
+ * Renders are not kept, the index is the source history.
+ */
+struct LandmarkMatcher
+{
+    std::mutex              _mutex; // _index
+    LandmarkIndex           _index;
+    LandmarkExtractor       _source; // Source stream only, like _sourceColumn
+    long long               _sourceColumn; // Last anchor column indexed
+    LandmarkExtractor       _capture; // Capture stream only, like _votes
+    int*                    _votes;
+    int                     _columnSize; // Samples per stft column
+    int                     _minOffset; // Lag range in columns
+    int                     _maxOffset;
+};
+
+// Detections reported per stft column, more in one column are only counted
+#define EARLY_HOWL_DETECTIONS 8
+
+// Early detector of the capture stream, only its analysing thread touches it
+struct EarlyHowl
+{
+    HowlDetector            _detector;
+    HowlDetection           _detections[EARLY_HOWL_DETECTIONS];
+    float                   _binHz;
+    long long               _lastDetection; // Capture position of the last column with an active detection, -1 before the first
+};
+
+struct AnalysisThread;
+
+// A context hosted by a HowlEngine, analysed on the engine's workers
+struct EnginePair
+{
+    HowlEngine*             _engine;
+    SampleQueue             _sourceQueue;
+    SampleQueue             _captureQueue;
+    std::mutex              _scheduleMutex;
+    std::condition_variable _idle; // Signalled when _scheduled is cleared
+    bool                    _scheduled;
+    std::atomic<bool>       _closing;
+    long long               _deadlineNs; // Age of the oldest queued sample, from its feed
+};
+
+struct HowlEngine
+{
+    int                     _sampleRate;
+    int                     _bufferMs;
+    int                     _bufferSize;
+    HowlLibConfig           _config;
+    FftPlan*                _fftPlan;
+    WorkPool*               _pool;
+    MatchWorkspace*         _workspaces;
+    float*                  _drainBuffers;
+    int                     _workers;
+    std::atomic<int>        _pairCount;
+};
+
+struct HowlLibContext
+{
+    HowlStream              _source;
+    HowlStream              _capture;
+    FftPlan*                _fftPlan;
+    int                     _sampleRate;
+    int                     _bufferMs;
+    int                     _bufferSize;
+    int                     _snapshotHop;
+    long long               _minLag; // _minLagMs and _maxLagMs resolved to samples
+    long long               _maxLag;
+    std::atomic<long long>  _alignment;
+    std::mutex*             _rendersMutex;
+    RenderPool*             _renderPool;
+    LoopDelay*              _loopDelay; // NULL without _delayTracking
+    LandmarkMatcher*        _landmarks; // NULL unless HOWL_BACKEND_LANDMARK
+    EarlyHowl*              _earlyHowl; // NULL with HOWL_DETECTION_OFF
+    fpPreHowlDetected       _preHowlCb;
+    fpHowlMatchDetected     _matchCb;
+    void*                   _matchCbData;
+    fpHowlEarlyDetected     _earlyCb;
+    void*                   _earlyCbData;
+    HowlLibConfig           _config;
+    AnalysisThread*         _analysis;
+    EnginePair*             _pair;
+    HowlStats               _stats;
+};
+
+// howl.cpp
+
+// HOWL_BACKEND_DEFAULT resolved for this build, -1 when unsupported
+int resolveHowlBackend(int backend);
+
+// Validates config for bufferSize and copies it with the backend resolved
+int resolveHowlLibConfig(HowlLibConfig* resolved, const HowlLibConfig* config, int bufferSize);
+
+// Samples between two snapshots of a window overlapping the previous one
+int getSnapshotHop(int bufferSize, int overlapPercentage);
+
+// Fills _minLag and _maxLag from the config, the sample rate and the buffer
+void resolveHowlLagRange(HowlLibContext* ctx);
+
+int initHowlStream(HowlLibContext* ctx, HowlStream* stream, const char* name, bool bWorkspace);
+
+void deinitHowlStream(HowlStream* stream);
+
+int processStreamAudio(HowlLibContext* ctx, HowlStream* stream, MatchWorkspace* workspace, const float* samples, int samplesSize);
+
+// Dropped audio moves the stream on as silence, positions keep counting every fed sample
+void skipStreamAudio(HowlLibContext* ctx, HowlStream* stream, long long samplesSize);
+
+// HowlEngine.cpp
+
+int feedEnginePair(HowlLibContext* ctx, SampleQueue* queue, const float* samples, int samplesSize);
+
+void detachEnginePair(HowlLibContext* ctx);
+
+// LoopDelay.cpp
+
+LoopDelay* createLoopDelay(HowlLibContext* ctx);
+
+void destroyLoopDelay(LoopDelay* loopDelay);
+
+// Source stream, at each snapshot
+void publishLoopDelaySource(HowlLibContext* ctx, HowlStream* stream);
+
+// Capture stream, at each snapshot before its render is published
+void trackLoopDelay(HowlLibContext* ctx, HowlStream* stream);
+
+// LandmarkMatch.cpp
+
+LandmarkMatcher* createLandmarkMatcher(HowlLibContext* ctx);
+
+void destroyLandmarkMatcher(LandmarkMatcher* matcher);
+
+// Instead of publishRender and checkAllRenders, render is not kept
+void checkLandmarks(HowlLibContext* ctx, HowlStream* stream, SpectrumRender* render);
+
+// EarlyHowl.cpp
+
+// After the capture stream is initialized
+EarlyHowl* createEarlyHowl(HowlLibContext* ctx);
+
+void destroyEarlyHowl(EarlyHowl* earlyHowl);
+
+// Capture stream, with the count of columns its last stft update added
+void trackEarlyHowl(HowlLibContext* ctx, HowlStream* stream, int columns);
+
+// A detection ended inside the stream's current window
+bool hasEarlyHowl(HowlLibContext* ctx, HowlStream* stream);
+
+// Stats.cpp
+
+long long getHowlTimeNs();
+
+void resetHowlStats(HowlStats* stats);
+
+void recordHowlStat(StatsHistogram* histogram, long long ns);
+
+StreamArrivals* createStreamArrivals();
+
+// Feeding thread, after samplesSize samples were accepted at timeNs
+void stampStreamArrival(StreamArrivals* arrivals, int samplesSize, long long timeNs);
+
+// Analysis thread, feed time of the sample before stream position, -1 when unknown.
+// end, when not NULL, gets the stream position once that feed was fed.
+long long getStreamArrival(StreamArrivals* arrivals, long long position, long long* end);
+
+// Trace.cpp
+
+extern std::atomic<bool> howlTraceEnabled;
+
+// Start of a span, 0 while tracing is off
+inline long long beginHowlTrace()
+{
+    return howlTraceEnabled.load(std::memory_order_relaxed) ? getHowlTimeNs() : 0;
+}
+
+// name must be a string literal, it is read when the trace is flushed
+void endHowlTrace(const char* name, long long start);
+
+// Render.cpp
+
+SpectrumRender* createNewRender(int width, int height, int format);
+
+// Fills the pool with count renders up front
+int initRenderPool(RenderPool* pool, int width, int height, int format, int count);
+
+// Every render of the pool must have been released
+void deinitRenderPool(RenderPool* pool);
+
+// Reference count 1, image and fft operand hold the previous user's content
+SpectrumRender* acquireRender(RenderPool* pool);
+
+void retainRender(SpectrumRender* render);
+
+void releaseRender(SpectrumRender* render);
+
+void fillRender(SpectrumRender* render, const StftStream* stft, float rangeDb);
+
+int initRenderHistory(RenderHistory* history, int capacity);
+
+// Releases the renders still held
+void deinitRenderHistory(RenderHistory* history);
+
+// Appends render, returns the oldest one when full, released by the caller
+SpectrumRender* pushRenderHistory(RenderHistory* history, SpectrumRender* render);
+
+// Renders with first <= _position <= last, sets the index of the first one from the oldest
+int findRenderRange(const RenderHistory* history, long long first, long long last, int* index);
+
+SpectrumRender* getHistoryRender(const RenderHistory* history, int index);
+
+// Averages blocks of 2^levels x 2^levels pixels into _coarse
+int fillCoarseRender(SpectrumRender* render, int levels);
+
+/**
+ * Adds render to its stream and snapshots the other stream's renders in
+ * one step, so each source/capture pair is seen by exactly one of its
+ * two renders. Only renders inside the lag range are snapshot.
+ * Returns the evicted render, released by the caller.
+ */
+SpectrumRender* publishRender(HowlLibContext* ctx, HowlStream* stream, SpectrumRender* render, std::vector<SpectrumRender*>* snapshot);
+
+void releaseRenderSnapshot(std::vector<SpectrumRender*>* snapshot);
+
+// Match.cpp
+
+int initMatchWorkspace(MatchWorkspace* workspace, const HowlLibConfig* config);
+
+void deinitMatchWorkspace(MatchWorkspace* workspace);
+
+int prepareRender(HowlLibContext* ctx, HowlStream* stream, MatchWorkspace* workspace, SpectrumRender* render);
+
+// Counts the match and calls fpPreHowlDetected and the match callback
+void reportHowlMatch(HowlLibContext* ctx, const HowlMatchEvent* event);
+
+// Scores render against the workspace snapshot of the other stream
+void checkAllRenders(HowlLibContext* ctx, MatchWorkspace* workspace, HowlStream* stream, SpectrumRender* render);
+
+// 1 - normalized result, then the average of its peaks
+float scoreMatchResult(MatchWorkspace* workspace, const float* result, int count);
+
+float matchRenders(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* sourceRender, SpectrumRender* captureRender);
+
+/**
+ * Scores count pairs in as few backend calls as possible, one per run of
+ * pairs sharing a source render. Order pairs by source to batch them.
+ * af::matchTemplate batches search images but takes a single 2D template,
+ * so pairs of different sources cannot share a launch.
+ */
+int matchRenderBatch(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores);
+
+#endif
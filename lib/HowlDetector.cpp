@@ -0,0 +1,167 @@
+// HowlDetector.cpp
+#include "HowlDetector.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+// Harmonics a candidate is compared with, 2nd up to this one
+#define HOWL_DETECTOR_HARMONICS 3
+
+int initHowlDetector(HowlDetector* detector, int bins, float paprDb, float phprDb, int frames)
+{
+    if (!detector || bins < 3 || frames < 1)
+    {
+        return -1;
+    }
+
+    memset(detector, 0, sizeof(HowlDetector));
+
+    detector->_bins = bins;
+    detector->_papr = powf(10.0f, paprDb / 10.0f);
+    detector->_phpr = powf(10.0f, phprDb / 10.0f);
+    detector->_frames = frames;
+
+    detector->_runs = new(std::nothrow) int[bins];
+    detector->_nextRuns = new(std::nothrow) int[bins];
+    detector->_candidates = new(std::nothrow) unsigned char[bins];
+
+    if (!detector->_runs || !detector->_nextRuns || !detector->_candidates)
+    {
+        deinitHowlDetector(detector);
+        return -1;
+    }
+
+    memset(detector->_runs, 0, sizeof(int) * bins);
+
+    return 0;
+}
+
+void deinitHowlDetector(HowlDetector* detector)
+{
+    if (!detector)
+    {
+        return;
+    }
+
+    delete [] detector->_runs;
+    delete [] detector->_nextRuns;
+    delete [] detector->_candidates;
+
+    memset(detector, 0, sizeof(HowlDetector));
+}
+
+// Lowest power ratio of the peak to its harmonics, -1 when none is below the last bin
+static float getHarmonicRatio(const float* column, int bins, int bin, float power)
+{
+    float ratio = -1.0f;
+
+    for (int h = 2; h <= HOWL_DETECTOR_HARMONICS && h * bin + 1 < bins; ++h)
+    {
+        // Strongest of the bins around the harmonic, bin spacing does not divide evenly
+        float harmonic = 0.0f;
+
+        for (int b = h * bin - 1; b <= h * bin + 1; ++b)
+        {
+            harmonic = fmaxf(harmonic, column[b] * column[b]);
+        }
+
+        const float r = harmonic > 0.0f ? power / harmonic : power;
+
+        ratio = ratio < 0.0f || r < ratio ? r : ratio;
+    }
+
+    return ratio;
+}
+
+int updateHowlDetector(HowlDetector* detector, const float* column, HowlDetection* detections, int maxDetections)
+{
+    const int bins = detector->_bins;
+
+    // DC bin is not sound, like the stft peak
+    double total = 0.0;
+
+    for (int b = 1; b < bins; ++b)
+    {
+        total += (double)column[b] * column[b];
+    }
+
+    const float average = (float)(total / (bins - 1));
+
+    memset(detector->_candidates, 0, bins);
+
+    if (average > 0.0f)
+    {
+        for (int b = 1; b + 1 < bins; ++b)
+        {
+            const float power = column[b] * column[b];
+
+            if (column[b] <= column[b - 1] || column[b] < column[b + 1] || power < detector->_papr * average)
+            {
+                continue;
+            }
+
+            const float harmonics = getHarmonicRatio(column, bins, b, power);
+
+            if (harmonics < 0.0f || harmonics >= detector->_phpr)
+            {
+                detector->_candidates[b] = 1;
+            }
+        }
+    }
+
+    const int* runs = detector->_runs;
+    int* nextRuns = detector->_nextRuns;
+    int found = 0;
+
+    detector->_active = 0;
+
+    nextRuns[0] = 0;
+    nextRuns[bins - 1] = 0;
+
+    for (int b = 1; b + 1 < bins; ++b)
+    {
+        if (!detector->_candidates[b])
+        {
+            nextRuns[b] = 0;
+            continue;
+        }
+
+        // A tone drifting by one bin keeps its run
+        int run = runs[b];
+
+        run = runs[b - 1] > run ? runs[b - 1] : run;
+        run = runs[b + 1] > run ? runs[b + 1] : run;
+
+        nextRuns[b] = run + 1;
+
+        if (nextRuns[b] >= detector->_frames)
+        {
+            detector->_active++;
+        }
+
+        // Reported once per onset
+        if (nextRuns[b] != detector->_frames)
+        {
+            continue;
+        }
+
+        if (found < maxDetections)
+        {
+            const float power = column[b] * column[b];
+            const float harmonics = getHarmonicRatio(column, bins, b, power);
+
+            HowlDetection& detection = detections[found];
+
+            detection._bin = b;
+            detection._paprDb = 10.0f * log10f(power / average);
+            detection._phprDb = harmonics > 0.0f ? 10.0f * log10f(harmonics) : 0.0f;
+        }
+
+        found++;
+    }
+
+    detector->_nextRuns = detector->_runs;
+    detector->_runs = nextRuns;
+
+    return found;
+}
@@ -0,0 +1,43 @@
+// HowlDetector.h
+#ifndef HOWLDETECTOR_H
+#define HOWLDETECTOR_H
+
+/**
+ * Streaming feedback detector on stft magnitude columns. A bin is a
+ * candidate in a column when it is a local peak whose power stands
+ * _papr above the column's average (peak to average power ratio) and
+ * _phpr above its 2nd and 3rd harmonics (peak to harmonic power ratio,
+ * feedback is close to a pure tone, voices and instruments are not).
+ * A candidate that persists for _frames consecutive columns, allowing
+ * one bin of drift, is detected once and stays active while it lasts.
+ */
+struct HowlDetector
+{
+    int             _bins;
+    float           _papr; // Power ratios, not dB
+    float           _phpr;
+    int             _frames;
+    int*            _runs; // Consecutive candidate columns ending at each bin
+    int*            _nextRuns;
+    int             _active; // Bins whose run reached _frames in the last column
+    unsigned char*  _candidates;
+};
+
+int initHowlDetector(HowlDetector* detector, int bins, float paprDb, float phprDb, int frames);
+
+void deinitHowlDetector(HowlDetector* detector);
+
+struct HowlDetection
+{
+    int             _bin;
+    float           _paprDb;
+    float           _phprDb; // Lowest over the harmonics below the last bin, 0 when there is none
+};
+
+/**
+ * Adds one column of _bins magnitudes. Returns the number of bins that
+ * reached _frames in this column, at most maxDetections are written.
+ */
+int updateHowlDetector(HowlDetector* detector, const float* column, HowlDetection* detections, int maxDetections);
+
+#endif
@@ -0,0 +1,426 @@
+#include "howl.h"
+#include "HowlContext.h"
+#include <new>
+#include <cstring>
+#include <stdio.h>
+#include <thread>
+
+#ifdef GPU_SUPPORT
+#include <arrayfire.h>
+#endif
+
+// Samples per stream a pair may analyse before yielding its worker
+#define ENGINE_QUANTUM_SAMPLES 4096
+
+static void runEnginePair(void* task, int worker);
+
+static void drainEngineQueue(HowlLibContext* ctx, HowlStream* stream, SampleQueue* queue, MatchWorkspace* workspace, float* buffer);
+
+HowlEngine* createHowlEngine()
+{
+    HowlEngine* engine = new(std::nothrow) HowlEngine;
+
+    if (!engine)
+    {
+        return nullptr;
+    }
+
+    engine->_fftPlan = nullptr;
+    engine->_pool = nullptr;
+    engine->_workspaces = nullptr;
+    engine->_drainBuffers = nullptr;
+    engine->_workers = 0;
+    engine->_pairCount.store(0);
+
+    return engine;
+}
+
+void destroyHowlEngine(
+    HowlEngine* engine
+)
+{
+    if (!engine)
+    {
+        return;
+    }
+
+    if (engine->_pairCount.load() != 0)
+    {
+        fprintf(stderr, "howl engine destroyed with %d pairs attached\n", engine->_pairCount.load());
+    }
+
+    if (engine->_pool)
+    {
+        deinitWorkPool(engine->_pool);
+        delete engine->_pool;
+    }
+
+    if (engine->_workspaces)
+    {
+        for (int i = 0; i < engine->_workers; ++i)
+        {
+            deinitMatchWorkspace(&engine->_workspaces[i]);
+        }
+
+        delete [] engine->_workspaces;
+    }
+
+    delete [] engine->_drainBuffers;
+
+    if (engine->_fftPlan)
+    {
+        deinitFftPlan(engine->_fftPlan);
+        delete engine->_fftPlan;
+    }
+
+    delete engine;
+}
+
+int initHowlEngine(
+    HowlEngine* engine,
+    int sampleRate, // SampleRate
+    int bufferMs, // Buffer ms
+    int backend, // HOWL_BACKEND_*
+    int workers // Workers, 0 for one per hardware thread
+)
+{
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = backend;
+
+    return initHowlEngineEx(engine, sampleRate, bufferMs, workers, &config);
+}
+
+int initHowlEngineEx(
+    HowlEngine* engine,
+    int sampleRate, // SampleRate
+    int bufferMs, // Buffer ms
+    int workers, // Workers, 0 for one per hardware thread
+    const HowlLibConfig* config
+)
+{
+    if (!engine || !config || engine->_pool || sampleRate <= 0 || bufferMs <= 0)
+    {
+        return -1;
+    }
+
+    engine->_sampleRate = sampleRate;
+    engine->_bufferMs = bufferMs;
+    engine->_bufferSize = bufferMs * sampleRate / 1000;
+
+    if (0 != resolveHowlLibConfig(&engine->_config, config, engine->_bufferSize))
+    {
+        return -1;
+    }
+
+    if (workers <= 0)
+    {
+        workers = (int)std::thread::hardware_concurrency();
+    }
+
+    if (workers <= 0)
+    {
+        workers = 1;
+    }
+
+    engine->_fftPlan = new(std::nothrow) FftPlan;
+
+    if (!engine->_fftPlan)
+    {
+        return -1;
+    }
+
+    // Every pair has the same geometry, so one plan serves all of them
+    if (0 != initFftPlan(engine->_fftPlan, getFftSizeForHop(engine->_bufferSize / engine->_config._spectrogramWidth)))
+    {
+        delete engine->_fftPlan;
+        engine->_fftPlan = nullptr;
+        return -1;
+    }
+
+    // Matcher scratch is per worker, not per pair
+    engine->_workspaces = new(std::nothrow) MatchWorkspace[workers]();
+    engine->_drainBuffers = new(std::nothrow) float[(size_t)workers * ENGINE_QUANTUM_SAMPLES];
+
+    if (!engine->_workspaces || !engine->_drainBuffers)
+    {
+        return -1;
+    }
+
+    engine->_workers = workers;
+
+    for (int i = 0; i < workers; ++i)
+    {
+        if (0 != initMatchWorkspace(&engine->_workspaces[i], &engine->_config))
+        {
+            return -1;
+        }
+    }
+
+#ifdef GPU_SUPPORT
+    if (engine->_config._backend == HOWL_BACKEND_ARRAYFIRE)
+    {
+        af::setDevice(0);
+        af::info();
+    }
+#endif
+
+    engine->_pool = new(std::nothrow) WorkPool;
+
+    if (!engine->_pool)
+    {
+        return -1;
+    }
+
+    if (0 != initWorkPool(engine->_pool, workers, runEnginePair))
+    {
+        delete engine->_pool;
+        engine->_pool = nullptr;
+        return -1;
+    }
+
+    return 0;
+}
+
+int initHowlLibContextEngine(
+    HowlLibContext* ctx, // HowlLib
+    HowlEngine* engine,
+    fpPreHowlDetected howlPreDetectCallback,
+    int queueMs, // Queue ms
+    int deadlineMs // Deadline ms
+)
+{
+    if (!ctx || !engine || !engine->_pool || queueMs <= 0 || deadlineMs <= 0)
+    {
+        return -1;
+    }
+
+    memset(&ctx->_source, 0, sizeof(HowlStream));
+    memset(&ctx->_capture, 0, sizeof(HowlStream));
+    ctx->_fftPlan = nullptr;
+    ctx->_analysis = nullptr;
+    ctx->_pair = nullptr;
+    ctx->_rendersMutex = nullptr;
+    ctx->_renderPool = nullptr;
+    ctx->_loopDelay = nullptr;
+    ctx->_landmarks = nullptr;
+    ctx->_earlyHowl = nullptr;
+    ctx->_alignment.store(0);
+
+    resetHowlStats(&ctx->_stats);
+
+    ctx->_sampleRate = engine->_sampleRate;
+    ctx->_bufferMs = engine->_bufferMs;
+    ctx->_bufferSize = engine->_bufferSize;
+    ctx->_config = engine->_config;
+    ctx->_snapshotHop = getSnapshotHop(engine->_bufferSize, engine->_config._overlapPercentage);
+
+    resolveHowlLagRange(ctx);
+
+    ctx->_preHowlCb = howlPreDetectCallback;
+    ctx->_matchCb = nullptr;
+    ctx->_matchCbData = nullptr;
+    ctx->_earlyCb = nullptr;
+    ctx->_earlyCbData = nullptr;
+
+    ctx->_rendersMutex = new(std::nothrow) std::mutex;
+    ctx->_renderPool = new(std::nothrow) RenderPool();
+
+    if (!ctx->_rendersMutex || !ctx->_renderPool)
+    {
+        return -1;
+    }
+
+    if (0 != initRenderPool(ctx->_renderPool, ctx->_config._spectrogramWidth, ctx->_config._spectrogramHeight, SPECTROGRAM_FORMAT, 2 * (ctx->_config._maxSpectrograms + 1)))
+    {
+        return -1;
+    }
+
+    if (ctx->_config._delayTracking && !(ctx->_loopDelay = createLoopDelay(ctx)))
+    {
+        return -1;
+    }
+
+    if (ctx->_config._backend == HOWL_BACKEND_LANDMARK && !(ctx->_landmarks = createLandmarkMatcher(ctx)))
+    {
+        return -1;
+    }
+
+    EnginePair* pair = new(std::nothrow) EnginePair;
+
+    if (!pair)
+    {
+        return -1;
+    }
+
+    const int queueSize = (int)((long long)queueMs * engine->_sampleRate / 1000);
+
+    if (0 != initSampleQueue(&pair->_sourceQueue, queueSize))
+    {
+        delete pair;
+        return -1;
+    }
+
+    if (0 != initSampleQueue(&pair->_captureQueue, queueSize))
+    {
+        deinitSampleQueue(&pair->_sourceQueue);
+        delete pair;
+        return -1;
+    }
+
+    pair->_engine = engine;
+    pair->_scheduled = false;
+    pair->_closing.store(false);
+    pair->_deadlineNs = (long long)deadlineMs * 1000000;
+
+    ctx->_pair = pair;
+    ctx->_fftPlan = engine->_fftPlan;
+
+    engine->_pairCount.fetch_add(1);
+
+    if (0 != initHowlStream(ctx, &ctx->_source, "source", false) ||
+        0 != initHowlStream(ctx, &ctx->_capture, "capture", false))
+    {
+        return -1;
+    }
+
+    if (ctx->_config._howlDetection != HOWL_DETECTION_OFF && !(ctx->_earlyHowl = createEarlyHowl(ctx)))
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+int feedEnginePair(HowlLibContext* ctx, SampleQueue* queue, const float* samples, int samplesSize)
+{
+    EnginePair* pair = ctx->_pair;
+
+    // A refused feed still schedules the pair, the worker takes its gap
+    const bool bPushed = pushSampleQueue(queue, samples, samplesSize);
+
+    bool bSubmit = false;
+
+    {
+        std::lock_guard<std::mutex> lock(pair->_scheduleMutex);
+
+        // A pair sits in at most one worker queue at a time
+        if (!pair->_scheduled)
+        {
+            pair->_scheduled = true;
+            bSubmit = true;
+        }
+    }
+
+    if (bSubmit)
+    {
+        submitWorkPool(pair->_engine->_pool, ctx, -1);
+    }
+
+    return bPushed ? 0 : -1;
+}
+
+void detachEnginePair(HowlLibContext* ctx)
+{
+    EnginePair* pair = ctx->_pair;
+
+    pair->_closing.store(true, std::memory_order_release);
+
+    // Feeds have stopped, wait for the worker holding the pair to let go
+    {
+        std::unique_lock<std::mutex> lock(pair->_scheduleMutex);
+
+        pair->_idle.wait(lock, [pair] { return !pair->_scheduled; });
+    }
+
+    deinitSampleQueue(&pair->_sourceQueue);
+    deinitSampleQueue(&pair->_captureQueue);
+
+    pair->_engine->_pairCount.fetch_sub(1);
+
+    delete pair;
+
+    ctx->_pair = nullptr;
+}
+
+static void runEnginePair(void* task, int worker)
+{
+    HowlLibContext* ctx = (HowlLibContext*)task;
+    EnginePair* pair = ctx->_pair;
+    HowlEngine* engine = pair->_engine;
+
+    if (!pair->_closing.load(std::memory_order_acquire))
+    {
+        float* buffer = engine->_drainBuffers + (size_t)worker * ENGINE_QUANTUM_SAMPLES;
+        MatchWorkspace* workspace = &engine->_workspaces[worker];
+
+        drainEngineQueue(ctx, &ctx->_source, &pair->_sourceQueue, workspace, buffer);
+        drainEngineQueue(ctx, &ctx->_capture, &pair->_captureQueue, workspace, buffer);
+    }
+
+    bool bMore;
+
+    {
+        std::lock_guard<std::mutex> lock(pair->_scheduleMutex);
+
+        bMore = !pair->_closing.load(std::memory_order_acquire) &&
+                (getSampleQueueSize(&pair->_sourceQueue) > 0 ||
+                 getSampleQueueSize(&pair->_captureQueue) > 0 ||
+                 getSampleQueueGap(&pair->_sourceQueue) > 0 ||
+                 getSampleQueueGap(&pair->_captureQueue) > 0);
+
+        // Under the lock, detach deletes the pair as soon as it can take it
+        if (!bMore)
+        {
+            pair->_scheduled = false;
+            pair->_idle.notify_all();
+        }
+    }
+
+    // Back of this worker's queue, every other pair gets its turn first
+    if (bMore)
+    {
+        submitWorkPool(engine->_pool, ctx, worker);
+    }
+}
+
+static void drainEngineQueue(HowlLibContext* ctx, HowlStream* stream, SampleQueue* queue, MatchWorkspace* workspace, float* buffer)
+{
+    EnginePair* pair = ctx->_pair;
+
+    const long long now = getHowlTimeNs();
+
+    // Feeds older than the deadline are dropped rather than analysed late, however short the queue
+    for (int queued = getSampleQueueSize(queue); queued > 0; queued = getSampleQueueSize(queue))
+    {
+        const long long position = getAudioRingPosition(stream->_ringBuffer);
+
+        long long end = 0;
+
+        // Not stamped yet means just fed
+        const long long arrival = getStreamArrival(stream->_arrivals, position + 1, &end);
+
+        if (arrival < 0 || now - arrival <= pair->_deadlineNs)
+        {
+            break;
+        }
+
+        const int skipped = skipSampleQueue(queue, end - position < queued ? (int)(end - position) : queued);
+
+        skipStreamAudio(ctx, stream, skipped);
+
+        ctx->_stats._lateSamples.fetch_add(skipped, std::memory_order_relaxed);
+    }
+
+    int samplesSize = popSampleQueue(queue, buffer, ENGINE_QUANTUM_SAMPLES);
+
+    if (samplesSize > 0)
+    {
+        processStreamAudio(ctx, stream, workspace, buffer, samplesSize);
+    }
+
+    // Feeds refused by the full queue, once everything before them is analysed
+    skipStreamAudio(ctx, stream, takeSampleQueueGap(queue));
+}
@@ -0,0 +1,386 @@
+// Landmark.cpp
+#include "Landmark.h"
+#include <new>
+#include <climits>
+#include <cstring>
+
+// A peak is the maximum of the pixels this many columns and bands around it
+#define LANDMARK_SPREAD_T 3
+#define LANDMARK_SPREAD_F 3
+// Loudest peaks kept per column
+#define LANDMARK_COLUMN_PEAKS 3
+// Peaks paired with an anchor lie up to this many columns after it and bands away
+#define LANDMARK_ZONE_T 32
+#define LANDMARK_ZONE_F 32
+#define LANDMARK_FANOUT 3
+// Slots probed per hash
+#define LANDMARK_PROBES 8
+
+int initLandmarkExtractor(LandmarkExtractor* extractor, int width, int height, int floor)
+{
+    if (!extractor || width <= LANDMARK_ZONE_T || height <= 0 || height > 4096)
+    {
+        return -1;
+    }
+
+    memset(extractor, 0, sizeof(LandmarkExtractor));
+
+    extractor->_width = width;
+    extractor->_height = height;
+    extractor->_floor = floor > 1 ? floor : 1;
+    extractor->_maxLandmarks = width * LANDMARK_COLUMN_PEAKS * LANDMARK_FANOUT;
+
+    extractor->_rowMax = new(std::nothrow) unsigned char[width * height];
+    extractor->_max = new(std::nothrow) unsigned char[width * height];
+    extractor->_peaks = new(std::nothrow) LandmarkPeak[width * LANDMARK_COLUMN_PEAKS];
+    extractor->_landmarks = new(std::nothrow) Landmark[extractor->_maxLandmarks];
+
+    if (!extractor->_rowMax || !extractor->_max || !extractor->_peaks || !extractor->_landmarks)
+    {
+        deinitLandmarkExtractor(extractor);
+        return -1;
+    }
+
+    return 0;
+}
+
+void deinitLandmarkExtractor(LandmarkExtractor* extractor)
+{
+    if (!extractor)
+    {
+        return;
+    }
+
+    delete [] extractor->_rowMax;
+    delete [] extractor->_max;
+    delete [] extractor->_peaks;
+    delete [] extractor->_landmarks;
+
+    memset(extractor, 0, sizeof(LandmarkExtractor));
+}
+
+int getLandmarkLastColumn(const LandmarkExtractor* extractor)
+{
+    return extractor->_width - 1 - LANDMARK_ZONE_T;
+}
+
+// Separable max filter, rows first then columns
+static void fillNeighbourMax(LandmarkExtractor* extractor, const unsigned char* image)
+{
+    const int width = extractor->_width;
+    const int height = extractor->_height;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const unsigned char* row = image + y * width;
+        unsigned char* out = extractor->_rowMax + y * width;
+
+        for (int x = 0; x < width; ++x)
+        {
+            const int from = x > LANDMARK_SPREAD_T ? x - LANDMARK_SPREAD_T : 0;
+            const int to = x + LANDMARK_SPREAD_T < width ? x + LANDMARK_SPREAD_T : width - 1;
+
+            unsigned char value = row[from];
+
+            for (int k = from + 1; k <= to; ++k)
+            {
+                value = row[k] > value ? row[k] : value;
+            }
+
+            out[x] = value;
+        }
+    }
+
+    for (int y = 0; y < height; ++y)
+    {
+        const int from = y > LANDMARK_SPREAD_F ? y - LANDMARK_SPREAD_F : 0;
+        const int to = y + LANDMARK_SPREAD_F < height ? y + LANDMARK_SPREAD_F : height - 1;
+
+        unsigned char* out = extractor->_max + y * width;
+
+        memcpy(out, extractor->_rowMax + from * width, width);
+
+        for (int k = from + 1; k <= to; ++k)
+        {
+            const unsigned char* row = extractor->_rowMax + k * width;
+
+            for (int x = 0; x < width; ++x)
+            {
+                out[x] = row[x] > out[x] ? row[x] : out[x];
+            }
+        }
+    }
+}
+
+// Peaks of columns first to last in column order, the loudest LANDMARK_COLUMN_PEAKS of each
+static int findColumnPeaks(LandmarkExtractor* extractor, const unsigned char* image, int first, int last)
+{
+    const int width = extractor->_width;
+    const int height = extractor->_height;
+
+    int count = 0;
+
+    for (int x = first; x <= last; ++x)
+    {
+        LandmarkPeak* column = extractor->_peaks + count;
+        unsigned char levels[LANDMARK_COLUMN_PEAKS];
+        int found = 0;
+
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char level = image[y * width + x];
+
+            if (level < extractor->_floor || level != extractor->_max[y * width + x])
+            {
+                continue;
+            }
+
+            // Insertion into the few loudest so far
+            int k = found < LANDMARK_COLUMN_PEAKS ? found++ : LANDMARK_COLUMN_PEAKS;
+
+            for (; k > 0 && levels[k - 1] < level; --k)
+            {
+                if (k < LANDMARK_COLUMN_PEAKS)
+                {
+                    levels[k] = levels[k - 1];
+                    column[k] = column[k - 1];
+                }
+            }
+
+            if (k < LANDMARK_COLUMN_PEAKS)
+            {
+                levels[k] = level;
+                column[k]._x = x;
+                column[k]._y = y;
+            }
+        }
+
+        count += found;
+    }
+
+    return count;
+}
+
+int extractLandmarks(LandmarkExtractor* extractor, const unsigned char* image, int first, int last, int timeBase)
+{
+    const int zoneLast = last + LANDMARK_ZONE_T < extractor->_width ? last + LANDMARK_ZONE_T : extractor->_width - 1;
+
+    if (first < 0 || first > last)
+    {
+        return 0;
+    }
+
+    fillNeighbourMax(extractor, image);
+
+    const int peakCount = findColumnPeaks(extractor, image, first, zoneLast);
+    const LandmarkPeak* peaks = extractor->_peaks;
+
+    int count = 0;
+
+    for (int i = 0; i < peakCount && peaks[i]._x <= last; ++i)
+    {
+        const LandmarkPeak& anchor = peaks[i];
+
+        int paired = 0;
+
+        for (int j = i + 1; j < peakCount && paired < LANDMARK_FANOUT; ++j)
+        {
+            const LandmarkPeak& target = peaks[j];
+            const int dt = target._x - anchor._x;
+            const int df = target._y - anchor._y;
+
+            if (dt > LANDMARK_ZONE_T)
+            {
+                break;
+            }
+
+            if (dt == 0 || df > LANDMARK_ZONE_F || df < -LANDMARK_ZONE_F)
+            {
+                continue;
+            }
+
+            // Unique for heights up to 4096 and zones up to 255 columns
+            Landmark& landmark = extractor->_landmarks[count++];
+
+            landmark._hash = ((unsigned int)anchor._y << 20) | ((unsigned int)target._y << 8) | (unsigned int)dt;
+            landmark._time = timeBase + anchor._x;
+
+            paired++;
+        }
+    }
+
+    return count;
+}
+
+static unsigned int getLandmarkSlot(const LandmarkIndex* index, unsigned int hash)
+{
+    unsigned int h = hash * 2654435761u;
+
+    h ^= h >> 15;
+
+    return h & index->_mask;
+}
+
+int initLandmarkIndex(LandmarkIndex* index, int horizon)
+{
+    if (!index || horizon <= 0 || horizon > (1 << 20))
+    {
+        return -1;
+    }
+
+    const unsigned int landmarks = (unsigned int)horizon * LANDMARK_COLUMN_PEAKS * LANDMARK_FANOUT;
+
+    unsigned int size = LANDMARK_PROBES;
+
+    while (size < 2u * landmarks)
+    {
+        size <<= 1;
+    }
+
+    index->_slots = new(std::nothrow) Landmark[size];
+
+    if (!index->_slots)
+    {
+        return -1;
+    }
+
+    // INT_MIN is older than any horizon, every slot starts free
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        index->_slots[i]._hash = 0;
+        index->_slots[i]._time = INT_MIN;
+    }
+
+    index->_mask = size - 1;
+    index->_horizon = horizon;
+    index->_newest = 0;
+
+    return 0;
+}
+
+void deinitLandmarkIndex(LandmarkIndex* index)
+{
+    if (!index)
+    {
+        return;
+    }
+
+    delete [] index->_slots;
+
+    index->_slots = nullptr;
+}
+
+void addLandmarks(LandmarkIndex* index, const Landmark* landmarks, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const Landmark& landmark = landmarks[i];
+
+        if (landmark._time > index->_newest)
+        {
+            index->_newest = landmark._time;
+        }
+
+        const int oldest = index->_newest - index->_horizon;
+        const unsigned int start = getLandmarkSlot(index, landmark._hash);
+
+        // First expired slot of the run, or its oldest landmark when the run is full
+        unsigned int slot = start;
+
+        for (unsigned int k = 0; k < LANDMARK_PROBES; ++k)
+        {
+            const unsigned int probe = (start + k) & index->_mask;
+            const int time = index->_slots[probe]._time;
+
+            if (time < oldest)
+            {
+                slot = probe;
+                break;
+            }
+
+            if (time < index->_slots[slot]._time)
+            {
+                slot = probe;
+            }
+        }
+
+        index->_slots[slot] = landmark;
+    }
+}
+
+int voteLandmarks(const LandmarkIndex* index, const Landmark* landmarks, int count, int minOffset, int maxOffset, int* votes)
+{
+    const int oldest = index->_newest - index->_horizon;
+
+    int cast = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Landmark& landmark = landmarks[i];
+        const unsigned int start = getLandmarkSlot(index, landmark._hash);
+
+        int offsets[LANDMARK_PROBES];
+        int voted = 0;
+
+        for (unsigned int k = 0; k < LANDMARK_PROBES; ++k)
+        {
+            const Landmark& slot = index->_slots[(start + k) & index->_mask];
+
+            if (slot._hash != landmark._hash || slot._time < oldest)
+            {
+                continue;
+            }
+
+            const int offset = landmark._time - slot._time;
+
+            if (offset < minOffset || offset > maxOffset)
+            {
+                continue;
+            }
+
+            // One vote per offset, however many probed slots agree on it
+            bool bVoted = false;
+
+            for (int j = 0; j < voted && !bVoted; ++j)
+            {
+                bVoted = offsets[j] == offset;
+            }
+
+            if (!bVoted)
+            {
+                offsets[voted++] = offset;
+                votes[offset - minOffset]++;
+                cast++;
+            }
+        }
+    }
+
+    return cast;
+}
+
+int countLandmarkHits(const LandmarkIndex* index, const Landmark* landmarks, int count, int minOffset, int maxOffset)
+{
+    const int oldest = index->_newest - index->_horizon;
+
+    int hits = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Landmark& landmark = landmarks[i];
+        const unsigned int start = getLandmarkSlot(index, landmark._hash);
+
+        for (unsigned int k = 0; k < LANDMARK_PROBES; ++k)
+        {
+            const Landmark& slot = index->_slots[(start + k) & index->_mask];
+            const int offset = landmark._time - slot._time;
+
+            if (slot._hash == landmark._hash && slot._time >= oldest && offset >= minOffset && offset <= maxOffset)
+            {
+                hits++;
+                break;
+            }
+        }
+    }
+
+    return hits;
+}
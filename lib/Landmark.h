@@ -0,0 +1,81 @@
+// Landmark.h
+#ifndef LANDMARK_H
+#define LANDMARK_H
+
+// Pair of spectral peaks, hashed from both bands and their distance in columns
+struct Landmark
+{
+    unsigned int    _hash;
+    int             _time; // Stream column of the first peak
+};
+
+struct LandmarkPeak
+{
+    int             _x;
+    int             _y;
+};
+
+/**
+ * Finds the local maxima of an 8 bit spectrogram (row = band) and pairs
+ * every peak with the next few peaks of a zone after it. Scratch is sized
+ * at init, extraction does not allocate.
+ */
+struct LandmarkExtractor
+{
+    int             _width;
+    int             _height;
+    int             _floor; // Quieter pixels are never peaks
+    unsigned char*  _rowMax; // Max over neighbouring columns, then over neighbouring bands
+    unsigned char*  _max;
+    LandmarkPeak*   _peaks;
+    Landmark*       _landmarks;
+    int             _maxLandmarks;
+};
+
+int initLandmarkExtractor(LandmarkExtractor* extractor, int width, int height, int floor);
+
+void deinitLandmarkExtractor(LandmarkExtractor* extractor);
+
+// Columns whose pairing zone is inside the image, anchors past this are left to the next window
+int getLandmarkLastColumn(const LandmarkExtractor* extractor);
+
+/**
+ * Landmarks of the peaks in columns first to last, first at least 0 and
+ * last at most getLandmarkLastColumn. Their time is timeBase + column.
+ * Returns their count, they stay in _landmarks until the next call.
+ */
+int extractLandmarks(LandmarkExtractor* extractor, const unsigned char* image, int first, int last, int timeBase);
+
+/**
+ * Open addressing hash index of landmarks. Every hash probes a bounded
+ * run of slots, so inserts and lookups are constant time. Landmarks older
+ * than _horizon columns behind the newest one are free slots, the index
+ * never grows nor needs clearing.
+ */
+struct LandmarkIndex
+{
+    Landmark*       _slots;
+    unsigned int    _mask;
+    int             _horizon;
+    int             _newest;
+};
+
+// Sized for every landmark horizon columns can hold at a load factor below one half
+int initLandmarkIndex(LandmarkIndex* index, int horizon);
+
+void deinitLandmarkIndex(LandmarkIndex* index);
+
+void addLandmarks(LandmarkIndex* index, const Landmark* landmarks, int count);
+
+/**
+ * Every indexed landmark with the hash of one of landmarks votes for the
+ * offset between the two, votes[offset - minOffset] for offsets between
+ * minOffset and maxOffset. One of landmarks adds at most one vote to an
+ * offset. Returns the number of votes cast.
+ */
+int voteLandmarks(const LandmarkIndex* index, const Landmark* landmarks, int count, int minOffset, int maxOffset, int* votes);
+
+// Landmarks with an indexed copy between minOffset and maxOffset, each counted once, at most count
+int countLandmarkHits(const LandmarkIndex* index, const Landmark* landmarks, int count, int minOffset, int maxOffset);
+
+#endif
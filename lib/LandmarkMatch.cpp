@@ -0,0 +1,213 @@
+// LandmarkMatch.cpp
+#include "HowlContext.h"
+#include <new>
+
+// Peaks quieter than this below the window peak are not landmarks
+#define LANDMARK_FLOOR_DB 40.0f
+// Fewer votes on one offset are never a match, whatever their share
+#define LANDMARK_MIN_VOTES 8
+
+// Rounded towards minus infinity, lags can be negative
+static long long floorDiv(long long a, long long b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+LandmarkMatcher* createLandmarkMatcher(HowlLibContext* ctx)
+{
+    // Peaks are picked on the 8 bit images
+    if (SPECTROGRAM_FORMAT != SPECTROGRAM_FORMAT_U8)
+    {
+        return nullptr;
+    }
+
+    LandmarkMatcher* matcher = new(std::nothrow) LandmarkMatcher();
+
+    if (!matcher)
+    {
+        return nullptr;
+    }
+
+    const int width = ctx->_config._spectrogramWidth;
+    const int height = ctx->_config._spectrogramHeight;
+    const float rangeDb = ctx->_config._rangeDb;
+    const int floor = rangeDb > LANDMARK_FLOOR_DB ? (int)(255.0f * (1.0f - LANDMARK_FLOOR_DB / rangeDb)) : 1;
+
+    // Same column grid as the stft of both streams
+    matcher->_columnSize = ctx->_bufferSize / width;
+    matcher->_minOffset = (int)floorDiv(ctx->_minLag, matcher->_columnSize);
+    matcher->_maxOffset = (int)-floorDiv(-ctx->_maxLag, matcher->_columnSize);
+    matcher->_sourceColumn = -1;
+
+    // Source landmarks stay indexed for the lag range and the windows on both ends of it
+    const int horizon = matcher->_maxOffset - matcher->_minOffset + 2 * width;
+
+    matcher->_votes = new(std::nothrow) int[matcher->_maxOffset - matcher->_minOffset + 1];
+
+    if (!matcher->_votes ||
+        0 != initLandmarkIndex(&matcher->_index, horizon) ||
+        0 != initLandmarkExtractor(&matcher->_source, width, height, floor) ||
+        0 != initLandmarkExtractor(&matcher->_capture, width, height, floor))
+    {
+        destroyLandmarkMatcher(matcher);
+        return nullptr;
+    }
+
+    return matcher;
+}
+
+void destroyLandmarkMatcher(LandmarkMatcher* matcher)
+{
+    if (!matcher)
+    {
+        return;
+    }
+
+    deinitLandmarkIndex(&matcher->_index);
+    deinitLandmarkExtractor(&matcher->_source);
+    deinitLandmarkExtractor(&matcher->_capture);
+
+    delete [] matcher->_votes;
+
+    delete matcher;
+}
+
+// Anchors not indexed by the previous source window, overlapping windows add each landmark once
+static void indexSourceLandmarks(HowlLibContext* ctx, LandmarkMatcher* matcher, SpectrumRender* render)
+{
+    const long long timeBase = render->_position / matcher->_columnSize - render->_width;
+    const int last = getLandmarkLastColumn(&matcher->_source);
+    const long long next = matcher->_sourceColumn + 1 - timeBase;
+    const int first = next > 0 ? (int)next : 0;
+
+    const int count = extractLandmarks(&matcher->_source, render->_image, first, last, (int)timeBase);
+
+    {
+        std::lock_guard<std::mutex> lock(matcher->_mutex);
+
+        addLandmarks(&matcher->_index, matcher->_source._landmarks, count);
+    }
+
+    matcher->_sourceColumn = timeBase + last;
+
+    ctx->_stats._landmarks.fetch_add(count, std::memory_order_relaxed);
+}
+
+// The whole capture window votes on one offset to the source
+static void voteCaptureLandmarks(HowlLibContext* ctx, LandmarkMatcher* matcher, SpectrumRender* render)
+{
+    const long long timeBase = render->_position / matcher->_columnSize - render->_width;
+    const long long alignment = floorDiv(ctx->_alignment.load(std::memory_order_relaxed), matcher->_columnSize);
+    const int range = matcher->_maxOffset - matcher->_minOffset + 1;
+
+    const int count = extractLandmarks(&matcher->_capture, render->_image, 0, getLandmarkLastColumn(&matcher->_capture), (int)timeBase);
+
+    int* votes = matcher->_votes;
+
+    for (int i = 0; i < range; ++i)
+    {
+        votes[i] = 0;
+    }
+
+    // Positions are floored to columns, a delay between two columns splits its votes
+    int best = 0;
+    int bestOffset = 0;
+    int hits = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(matcher->_mutex);
+
+        voteLandmarks(&matcher->_index,
+                      matcher->_capture._landmarks,
+                      count,
+                      (int)(matcher->_minOffset + alignment),
+                      (int)(matcher->_maxOffset + alignment),
+                      votes);
+
+        for (int i = 0; i < range; ++i)
+        {
+            const int sum = votes[i] + (i > 0 ? votes[i - 1] : 0) + (i + 1 < range ? votes[i + 1] : 0);
+
+            if (sum > best)
+            {
+                best = sum;
+                bestOffset = i;
+            }
+        }
+
+        // A landmark can vote on all three offsets, it counts once in the share
+        if (best > 0)
+        {
+            const int offset = (int)(matcher->_minOffset + alignment) + bestOffset;
+
+            hits = countLandmarkHits(&matcher->_index,
+                                     matcher->_capture._landmarks,
+                                     count,
+                                     bestOffset > 0 ? offset - 1 : offset,
+                                     bestOffset + 1 < range ? offset + 1 : offset);
+        }
+    }
+
+    ctx->_stats._landmarks.fetch_add(count, std::memory_order_relaxed);
+
+    // Share of the capture landmarks on the offset, lower is more alike like the image scores
+    const float score = count > 0 ? 1.0f - (float)hits / count : 1.0f;
+
+    if (hits < LANDMARK_MIN_VOTES || score >= ctx->_config._matchThreshold)
+    {
+        return;
+    }
+
+    // Centre of the votes around the best offset, closer than one column
+    double centre = bestOffset;
+
+    if (bestOffset > 0)
+    {
+        centre -= (double)votes[bestOffset - 1] / best;
+    }
+
+    if (bestOffset + 1 < range)
+    {
+        centre += (double)votes[bestOffset + 1] / best;
+    }
+
+    const long long lag = (long long)((centre + matcher->_minOffset) * matcher->_columnSize + 0.5);
+
+    HowlMatchEvent event;
+
+    event._sourcePosition = render->_position - ctx->_alignment.load(std::memory_order_relaxed) - lag;
+    event._capturePosition = render->_position;
+    event._score = score;
+    event._sourceIndex = -1;
+    event._captureIndex = render->_index;
+
+    reportHowlMatch(ctx, &event);
+}
+
+void checkLandmarks(HowlLibContext* ctx, HowlStream* stream, SpectrumRender* render)
+{
+    LandmarkMatcher* matcher = ctx->_landmarks;
+
+    const long long start = getHowlTimeNs();
+    const long long trace = beginHowlTrace();
+
+    if (stream == &ctx->_source)
+    {
+        indexSourceLandmarks(ctx, matcher, render);
+    }
+    else
+    {
+        voteCaptureLandmarks(ctx, matcher, render);
+    }
+
+    endHowlTrace("landmarks", trace);
+
+    recordHowlStat(&ctx->_stats._matching, getHowlTimeNs() - start);
+
+    const long long arrival = getStreamArrival(stream->_arrivals, render->_position, NULL);
+
+    if (arrival >= 0)
+    {
+        recordHowlStat(&ctx->_stats._detection, getHowlTimeNs() - arrival);
+    }
+}
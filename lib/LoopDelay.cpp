@@ -0,0 +1,143 @@
+// LoopDelay.cpp
+#include "HowlContext.h"
+#include <new>
+#include <climits>
+#include <cstring>
+
+// Decimated to about this rate before the correlation
+#define LOOP_DELAY_RATE 8000
+
+// Rounded towards minus infinity, lags can be negative
+static long long floorDiv(long long a, long long b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+LoopDelay* createLoopDelay(HowlLibContext* ctx)
+{
+    LoopDelay* loopDelay = new(std::nothrow) LoopDelay();
+
+    if (!loopDelay)
+    {
+        return nullptr;
+    }
+
+    const int decimation = ctx->_sampleRate > LOOP_DELAY_RATE ? ctx->_sampleRate / LOOP_DELAY_RATE : 1;
+
+    if (0 != initDelayEstimator(&loopDelay->_estimator, ctx->_bufferSize, decimation))
+    {
+        delete loopDelay;
+        return nullptr;
+    }
+
+    const int length = loopDelay->_estimator._length;
+
+    loopDelay->_sourceWindow = new(std::nothrow) double[length];
+    loopDelay->_sourceCopy = new(std::nothrow) double[length];
+    loopDelay->_captureWindow = new(std::nothrow) double[length];
+    loopDelay->_sourcePosition = -1;
+    loopDelay->_delay.store(LLONG_MIN);
+    loopDelay->_estimate.store(0);
+    loopDelay->_coherence.store(0.0f);
+
+    if (!loopDelay->_sourceWindow || !loopDelay->_sourceCopy || !loopDelay->_captureWindow)
+    {
+        destroyLoopDelay(loopDelay);
+        return nullptr;
+    }
+
+    return loopDelay;
+}
+
+void destroyLoopDelay(LoopDelay* loopDelay)
+{
+    if (!loopDelay)
+    {
+        return;
+    }
+
+    deinitDelayEstimator(&loopDelay->_estimator);
+
+    delete [] loopDelay->_sourceWindow;
+    delete [] loopDelay->_sourceCopy;
+    delete [] loopDelay->_captureWindow;
+
+    delete loopDelay;
+}
+
+void publishLoopDelaySource(HowlLibContext* ctx, HowlStream* stream)
+{
+    LoopDelay* loopDelay = ctx->_loopDelay;
+
+    std::lock_guard<std::mutex> lock(loopDelay->_mutex);
+
+    decimateDelayWindow(&loopDelay->_estimator, getAudioRingWindow(stream->_ringBuffer), loopDelay->_sourceWindow);
+
+    loopDelay->_sourcePosition = getAudioRingPosition(stream->_ringBuffer);
+}
+
+void trackLoopDelay(HowlLibContext* ctx, HowlStream* stream)
+{
+    LoopDelay* loopDelay = ctx->_loopDelay;
+    DelayEstimator* estimator = &loopDelay->_estimator;
+
+    const long long trace = beginHowlTrace();
+
+    const long long capturePosition = getAudioRingPosition(stream->_ringBuffer);
+
+    long long sourcePosition;
+
+    // Only the copy is made under the lock, the source stream never waits on the transforms
+    {
+        std::lock_guard<std::mutex> lock(loopDelay->_mutex);
+
+        sourcePosition = loopDelay->_sourcePosition;
+
+        if (sourcePosition >= 0)
+        {
+            memcpy(loopDelay->_sourceCopy, loopDelay->_sourceWindow, sizeof(double) * estimator->_length);
+        }
+    }
+
+    float coherence = 0.0f;
+    long long delay = 0;
+
+    if (sourcePosition >= 0)
+    {
+        decimateDelayWindow(estimator, getAudioRingWindow(stream->_ringBuffer), loopDelay->_captureWindow);
+
+        // delay = lag * decimation + offset, kept inside the configured lag range
+        const long long offset = capturePosition - sourcePosition;
+        const long long decimation = estimator->_decimation;
+        const long long length = estimator->_length;
+
+        long long minLag = -floorDiv(offset - ctx->_minLag, decimation);
+        long long maxLag = floorDiv(ctx->_maxLag - offset, decimation);
+
+        // estimateDelay clamps to half a window, windows too far apart leave an empty range
+        minLag = minLag < -length ? -length : (minLag > length ? length + 1 : minLag);
+        maxLag = maxLag > length ? length : (maxLag < -length ? -length - 1 : maxLag);
+
+        int lag = 0;
+
+        coherence = estimateDelay(estimator, loopDelay->_sourceCopy, loopDelay->_captureWindow, (int)minLag, (int)maxLag, &lag);
+
+        delay = lag * decimation + offset;
+    }
+
+    loopDelay->_estimate.store(delay, std::memory_order_relaxed);
+    loopDelay->_coherence.store(coherence, std::memory_order_relaxed);
+
+    if (coherence >= ctx->_config._delayCoherence)
+    {
+        loopDelay->_delay.store(delay, std::memory_order_relaxed);
+    }
+    else
+    {
+        loopDelay->_delay.store(LLONG_MIN, std::memory_order_relaxed);
+
+        ctx->_stats._incoherentSnapshots.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    endHowlTrace("gcc_phat", trace);
+}
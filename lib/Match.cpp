@@ -0,0 +1,679 @@
+#include "HowlContext.h"
+#include "Util.h"
+#include <new>
+#include <stdio.h>
+#include <float.h>
+#include <cstring>
+
+#ifdef GPU_SUPPORT
+#include <arrayfire.h>
+#endif
+
+using namespace std;
+
+// These return the time spent in peak scoring
+static long long matchRenderPyramid(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores);
+
+static long long matchRenderGroups(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores);
+
+static long long matchRenderGroup(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* sourceRender, SpectrumRender* const* captures, int count, float* scores);
+
+float scoreMatchResult(MatchWorkspace* workspace, const float* result, int count);
+
+static float averagePeak(PeakWorkspace* peaks, const float* surface, int count);
+
+int initMatchWorkspace(MatchWorkspace* workspace, const HowlLibConfig* config)
+{
+    const int width = config->_spectrogramWidth;
+    const int height = config->_spectrogramHeight;
+    const int maxRenders = config->_maxSpectrograms;
+    const int backend = config->_backend;
+
+    workspace->_cpuMatcher = nullptr;
+    workspace->_fftMatcher = nullptr;
+    workspace->_surface = new(std::nothrow) vector<float>(width * height);
+    workspace->_snapshot = new(std::nothrow) vector<SpectrumRender*>;
+    workspace->_batchSources = new(std::nothrow) vector<SpectrumRender*>;
+    workspace->_batchCaptures = new(std::nothrow) vector<SpectrumRender*>;
+    workspace->_batchScores = new(std::nothrow) vector<float>;
+    workspace->_batchPixels = new(std::nothrow) vector<unsigned char>;
+    workspace->_batchSurfaces = new(std::nothrow) vector<float>;
+    workspace->_batchIndices = new(std::nothrow) vector<unsigned int>;
+    workspace->_peaks = new(std::nothrow) PeakWorkspace;
+    workspace->_coarseMatcher = nullptr;
+    workspace->_fineSources = new(std::nothrow) vector<SpectrumRender*>;
+    workspace->_fineCaptures = new(std::nothrow) vector<SpectrumRender*>;
+    workspace->_fineScores = new(std::nothrow) vector<float>;
+    workspace->_fineIndices = new(std::nothrow) vector<int>;
+
+    if (!workspace->_surface || !workspace->_snapshot ||
+        !workspace->_batchSources || !workspace->_batchCaptures || !workspace->_batchScores ||
+        !workspace->_batchPixels || !workspace->_batchSurfaces || !workspace->_batchIndices ||
+        !workspace->_peaks || !workspace->_fineSources || !workspace->_fineCaptures ||
+        !workspace->_fineScores || !workspace->_fineIndices)
+    {
+        return -1;
+    }
+
+    reservePeakWorkspace(workspace->_peaks, width * height);
+
+    // A new render pairs with at most every render of the other stream
+    const int maxPairs = maxRenders;
+
+    // No allocation while the renders lock is held, nor per batch
+    workspace->_snapshot->reserve(maxRenders);
+    workspace->_batchSources->reserve(maxPairs);
+    workspace->_batchCaptures->reserve(maxPairs);
+    workspace->_batchScores->resize(maxPairs);
+    workspace->_fineSources->reserve(maxPairs);
+    workspace->_fineCaptures->reserve(maxPairs);
+    workspace->_fineScores->resize(maxPairs);
+    workspace->_fineIndices->reserve(maxPairs);
+
+    if (backend == HOWL_BACKEND_ARRAYFIRE)
+    {
+        workspace->_batchPixels->resize((size_t)maxRenders * width * height * sizeof(float));
+        workspace->_batchSurfaces->resize((size_t)maxRenders * width * height);
+        workspace->_batchIndices->resize((size_t)maxRenders * width * height);
+    }
+
+    if (config->_pyramidLevels > 0)
+    {
+        const int coarseWidth = width >> config->_pyramidLevels;
+        const int coarseHeight = height >> config->_pyramidLevels;
+
+        workspace->_coarseMatcher = new(std::nothrow) CpuMatcher;
+
+        if (!workspace->_coarseMatcher ||
+            0 != initCpuMatcher(workspace->_coarseMatcher,
+                                coarseWidth,
+                                coarseHeight,
+                                coarseWidth,
+                                coarseHeight))
+        {
+            delete workspace->_coarseMatcher;
+            workspace->_coarseMatcher = nullptr;
+            return -1;
+        }
+    }
+
+    if (backend == HOWL_BACKEND_CPU)
+    {
+        workspace->_cpuMatcher = new(std::nothrow) CpuMatcher;
+
+        if (!workspace->_cpuMatcher ||
+            0 != initCpuMatcher(workspace->_cpuMatcher,
+                                width,
+                                height,
+                                width,
+                                height))
+        {
+            delete workspace->_cpuMatcher;
+            workspace->_cpuMatcher = nullptr;
+            return -1;
+        }
+    }
+    else if (backend == HOWL_BACKEND_FFT)
+    {
+        workspace->_fftMatcher = new(std::nothrow) FftMatcher;
+
+        if (!workspace->_fftMatcher ||
+            0 != initFftMatcher(workspace->_fftMatcher,
+                                width,
+                                height))
+        {
+            delete workspace->_fftMatcher;
+            workspace->_fftMatcher = nullptr;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void deinitMatchWorkspace(MatchWorkspace* workspace)
+{
+    if (workspace->_cpuMatcher)
+    {
+        deinitCpuMatcher(workspace->_cpuMatcher);
+        delete workspace->_cpuMatcher;
+    }
+
+    if (workspace->_fftMatcher)
+    {
+        deinitFftMatcher(workspace->_fftMatcher);
+        delete workspace->_fftMatcher;
+    }
+
+    if (workspace->_coarseMatcher)
+    {
+        deinitCpuMatcher(workspace->_coarseMatcher);
+        delete workspace->_coarseMatcher;
+    }
+
+    delete workspace->_surface;
+    delete workspace->_snapshot;
+    delete workspace->_batchSources;
+    delete workspace->_batchCaptures;
+    delete workspace->_batchScores;
+    delete workspace->_batchPixels;
+    delete workspace->_batchSurfaces;
+    delete workspace->_batchIndices;
+    delete workspace->_peaks;
+    delete workspace->_fineSources;
+    delete workspace->_fineCaptures;
+    delete workspace->_fineScores;
+    delete workspace->_fineIndices;
+
+    workspace->_cpuMatcher = nullptr;
+    workspace->_fftMatcher = nullptr;
+    workspace->_surface = nullptr;
+    workspace->_snapshot = nullptr;
+    workspace->_batchSources = nullptr;
+    workspace->_batchCaptures = nullptr;
+    workspace->_batchScores = nullptr;
+    workspace->_batchPixels = nullptr;
+    workspace->_batchSurfaces = nullptr;
+    workspace->_batchIndices = nullptr;
+    workspace->_peaks = nullptr;
+    workspace->_coarseMatcher = nullptr;
+    workspace->_fineSources = nullptr;
+    workspace->_fineCaptures = nullptr;
+    workspace->_fineScores = nullptr;
+    workspace->_fineIndices = nullptr;
+}
+
+int prepareRender(HowlLibContext* ctx, HowlStream* stream, MatchWorkspace* workspace, SpectrumRender* render)
+{
+    FftMatcher* matcher = workspace->_fftMatcher;
+
+    if (ctx->_config._pyramidLevels > 0 && 0 != fillCoarseRender(render, ctx->_config._pyramidLevels))
+    {
+        return -1;
+    }
+
+    if (ctx->_config._backend != HOWL_BACKEND_FFT || !matcher)
+    {
+        return 0;
+    }
+
+    // Transformed once before publishing, so matchers only ever read it
+    if (!render->_fftOperand)
+    {
+        render->_fftOperand = createFftMatchOperand(matcher);
+    }
+
+    if (!render->_fftOperand)
+    {
+        return -1;
+    }
+
+    const bool bU8 = render->_format == SPECTROGRAM_FORMAT_U8;
+
+    if (stream == &ctx->_source)
+    {
+        prepareFftTemplate(matcher, render->_fftOperand, render->_image, bU8);
+    }
+    else
+    {
+        prepareFftSearch(matcher, render->_fftOperand, render->_image, bU8);
+    }
+
+    return 0;
+}
+
+void checkAllRenders(HowlLibContext* ctx, MatchWorkspace* workspace, HowlStream* stream, SpectrumRender* render)
+{
+    vector<SpectrumRender*>& others = *workspace->_snapshot;
+    vector<SpectrumRender*>& batchSources = *workspace->_batchSources;
+    vector<SpectrumRender*>& batchCaptures = *workspace->_batchCaptures;
+
+    const bool bSource = stream == &ctx->_source;
+
+    batchSources.clear();
+    batchCaptures.clear();
+
+    // The snapshot only holds renders inside the lag range
+    for (int i = 0; i < others.size(); ++i)
+    {
+        SpectrumRender* other = others[i];
+
+        batchSources.push_back(bSource ? render : other);
+        batchCaptures.push_back(bSource ? other : render);
+    }
+
+    try
+    {
+        const int count = (int)batchSources.size();
+
+        float* scores = &workspace->_batchScores->front();
+
+        if (count > 0)
+        {
+            matchRenderBatch(ctx, workspace, &batchSources.front(), &batchCaptures.front(), count, scores);
+
+            ctx->_stats._pairsScored.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        const long long arrival = getStreamArrival(stream->_arrivals, render->_position, NULL);
+
+        if (arrival >= 0)
+        {
+            recordHowlStat(&ctx->_stats._detection, getHowlTimeNs() - arrival);
+        }
+
+        for (int k = 0; k < count; ++k)
+        {
+            float avgPeak = scores[k];
+
+            bool bMatch = true;
+
+            if (avgPeak >= ctx->_config._matchThreshold)
+            {
+                bMatch = false;
+            }
+
+            if (bMatch)
+            {
+                HowlMatchEvent event;
+
+                event._sourcePosition = batchSources[k]->_position;
+                event._capturePosition = batchCaptures[k]->_position;
+                event._score = avgPeak;
+                event._sourceIndex = batchSources[k]->_index;
+                event._captureIndex = batchCaptures[k]->_index;
+
+                reportHowlMatch(ctx, &event);
+            }
+        }
+    }
+    catch(const std::exception& e)
+    {
+        ctx->_stats._errors.fetch_add(1, std::memory_order_relaxed);
+
+        fprintf(stderr, "%s\n", e.what());
+    }
+
+    releaseRenderSnapshot(workspace->_snapshot);
+}
+
+void reportHowlMatch(HowlLibContext* ctx, const HowlMatchEvent* event)
+{
+    ctx->_stats._matches.fetch_add(1, std::memory_order_relaxed);
+
+    const long long trace = beginHowlTrace();
+
+    if (ctx->_preHowlCb != NULL)
+    {
+        (*ctx->_preHowlCb)();
+    }
+
+    if (ctx->_matchCb != NULL)
+    {
+        (*ctx->_matchCb)(ctx->_matchCbData, event);
+    }
+
+    endHowlTrace("callback", trace);
+}
+
+float matchRenders(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* sourceRender, SpectrumRender* captureRender)
+{
+    float score = 1.0f;
+
+    matchRenderBatch(ctx, workspace, &sourceRender, &captureRender, 1, &score);
+
+    return score;
+}
+
+int matchRenderBatch(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores)
+{
+    const long long start = getHowlTimeNs();
+
+    const long long peaksNs = ctx->_config._pyramidLevels > 0 ?
+        matchRenderPyramid(ctx, workspace, sources, captures, count, scores) :
+        matchRenderGroups(ctx, workspace, sources, captures, count, scores);
+
+    recordHowlStat(&ctx->_stats._matching, getHowlTimeNs() - start - peaksNs);
+    recordHowlStat(&ctx->_stats._peaks, peaksNs);
+
+    return 0;
+}
+
+// Scores every pair on the coarse images, only pairs that could still match go to the backend
+static long long matchRenderPyramid(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores)
+{
+    CpuMatcher* matcher = workspace->_coarseMatcher;
+
+    vector<SpectrumRender*>& fineSources = *workspace->_fineSources;
+    vector<SpectrumRender*>& fineCaptures = *workspace->_fineCaptures;
+    vector<int>& fineIndices = *workspace->_fineIndices;
+
+    const int coarsePixels = matcher->_searchWidth * matcher->_searchHeight;
+    const float reject = ctx->_config._matchThreshold + ctx->_config._pyramidMargin;
+
+    long long peaksNs = 0;
+
+    fineSources.clear();
+    fineCaptures.clear();
+    fineIndices.clear();
+
+    for (int i = 0; i < count; ++i)
+    {
+        // Pairs of one source are consecutive
+        if (i == 0 || sources[i] != sources[i - 1])
+        {
+            setCpuMatchTemplate(matcher, sources[i]->_coarse, false);
+        }
+
+        setCpuMatchSearch(matcher, captures[i]->_coarse, false);
+
+        const long long trace = beginHowlTrace();
+
+        runCpuMatch(matcher, CPU_MATCH_ZSSD);
+
+        endHowlTrace("coarse_match", trace);
+
+        const long long start = getHowlTimeNs();
+
+        const float coarse = scoreMatchResult(workspace, matcher->_result, coarsePixels);
+
+        peaksNs += getHowlTimeNs() - start;
+
+        // Nothing bounds coarse above fine, the margin is a measured heuristic (bench/pyramid)
+        if (coarse >= reject)
+        {
+            scores[i] = coarse;
+            continue;
+        }
+
+        fineSources.push_back(sources[i]);
+        fineCaptures.push_back(captures[i]);
+        fineIndices.push_back(i);
+    }
+
+    const int fine = (int)fineIndices.size();
+
+    ctx->_stats._pairsCoarse.fetch_add(count - fine, std::memory_order_relaxed);
+
+    if (fine == 0)
+    {
+        return peaksNs;
+    }
+
+    float* fineScores = &workspace->_fineScores->front();
+
+    peaksNs += matchRenderGroups(ctx, workspace, &fineSources.front(), &fineCaptures.front(), fine, fineScores);
+
+    for (int k = 0; k < fine; ++k)
+    {
+        scores[fineIndices[k]] = fineScores[k];
+    }
+
+    return peaksNs;
+}
+
+// Consecutive pairs of the same source share one template
+static long long matchRenderGroups(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* const* sources, SpectrumRender* const* captures, int count, float* scores)
+{
+    long long peaksNs = 0;
+
+    int first = 0;
+
+    while (first < count)
+    {
+        int last = first + 1;
+
+        while (last < count && sources[last] == sources[first])
+        {
+            ++last;
+        }
+
+        peaksNs += matchRenderGroup(ctx, workspace, sources[first], captures + first, last - first, scores + first);
+
+        first = last;
+    }
+
+    return peaksNs;
+}
+
+static long long matchRenderGroup(HowlLibContext* ctx, MatchWorkspace* workspace, SpectrumRender* sourceRender, SpectrumRender* const* captures, int count, float* scores)
+{
+    long long peaksNs = 0;
+
+    const int width = sourceRender->_width;
+    const int height = sourceRender->_height;
+    const bool bU8 = sourceRender->_format == SPECTROGRAM_FORMAT_U8;
+
+    if (ctx->_config._backend == HOWL_BACKEND_CPU)
+    {
+        CpuMatcher* matcher = workspace->_cpuMatcher;
+
+        // Template statistics once for the whole group
+        setCpuMatchTemplate(matcher, sourceRender->_image, bU8);
+
+        for (int i = 0; i < count; ++i)
+        {
+            setCpuMatchSearch(matcher, captures[i]->_image, bU8);
+
+            const long long trace = beginHowlTrace();
+
+            runCpuMatch(matcher, CPU_MATCH_ZSSD);
+
+            endHowlTrace("match", trace);
+
+            const long long start = getHowlTimeNs();
+
+            scores[i] = scoreMatchResult(workspace, matcher->_result, width * height);
+
+            peaksNs += getHowlTimeNs() - start;
+        }
+
+        return peaksNs;
+    }
+
+    if (ctx->_config._backend == HOWL_BACKEND_FFT)
+    {
+        FftMatcher* matcher = workspace->_fftMatcher;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (!sourceRender->_fftOperand || !captures[i]->_fftOperand)
+            {
+                scores[i] = 1.0f;
+                continue;
+            }
+
+            const long long trace = beginHowlTrace();
+
+            runFftMatch(matcher, captures[i]->_fftOperand, sourceRender->_fftOperand, FFT_MATCH_ZSSD);
+
+            endHowlTrace("match", trace);
+
+            const long long start = getHowlTimeNs();
+
+            scores[i] = scoreMatchResult(workspace, matcher->_result, width * height);
+
+            peaksNs += getHowlTimeNs() - start;
+        }
+
+        return peaksNs;
+    }
+
+#ifdef GPU_SUPPORT
+    const size_t pixelSize = bU8 ? sizeof(unsigned char) : sizeof(float);
+    const size_t imageBytes = (size_t)width * height * pixelSize;
+    const int imagePixels = width * height;
+
+    vector<unsigned char>& pixels = *workspace->_batchPixels;
+    vector<float>& extremaValues = *workspace->_batchSurfaces;
+    vector<unsigned int>& extremaIndices = *workspace->_batchIndices;
+    vector<float>& slices = *workspace->_surface;
+
+    // Captures stacked along the third dimension, one upload for the group
+    for (int i = 0; i < count; ++i)
+    {
+        memcpy(&pixels[i * imageBytes], captures[i]->_image, imageBytes);
+    }
+
+    long long trace = beginHowlTrace();
+
+    af::array tmpl(width, height, bU8 ? u8 : f32);
+    af::array search(width, height, count, bU8 ? u8 : f32);
+
+    tmpl.write(sourceRender->_image, imageBytes);
+    search.write(&pixels.front(), imageBytes * count);
+
+    endHowlTrace("af_upload", trace);
+
+    trace = beginHowlTrace();
+
+    af::array result =
+        matchTemplate(search, tmpl, AF_ZSSD);
+
+    endHowlTrace("matchTemplate", trace);
+
+    // Lazy on the device, the download below runs it
+    trace = beginHowlTrace();
+
+    // Per slice min/max stay on the device, 1 - normalized prepares for peaks
+    af::array mn = af::min(af::min(result, 0), 1);
+    af::array mx = af::max(af::max(result, 0), 1);
+    af::array range = af::select(mx - mn > 0, mx - mn, 1.0);
+
+    af::array disp_res = 1.0 - (result - af::tile(mn, width, height)) / af::tile(range, width, height);
+
+    // Sign changes of the derivative of every flattened slice, as in findPeaks
+    af::array v = af::moddims(disp_res, imagePixels, count);
+    af::array dx = af::diff1(v, 0);
+
+    dx = af::select(dx == 0.0, -EPS, dx);
+
+    af::array turns = dx(af::seq(0, imagePixels - 3), af::span) * dx(af::seq(1, imagePixels - 2), af::span) < 0.0;
+    af::array edge = af::constant(0, 1, count, b8);
+
+    // Only the extrema and 4 values per slice cross to the host, not the surfaces
+    af::array at = af::where(af::join(0, edge, turns, edge));
+    af::array extrema = af::flat(v)(at);
+    af::array bounds = af::join(0,
+                                af::join(0, v.row(0), v.row(imagePixels - 1)),
+                                af::join(0, af::min(v, 0), af::max(v, 0)));
+
+    const int extremaCount = (int)at.elements();
+
+    if (extremaCount > 0)
+    {
+        at.host(&extremaIndices.front());
+        extrema.host(&extremaValues.front());
+    }
+
+    if ((int)slices.size() < 4 * count)
+    {
+        slices.resize(4 * count);
+    }
+
+    bounds.host(&slices.front());
+
+    endHowlTrace("normalize", trace);
+
+    const long long start = getHowlTimeNs();
+
+    PeakWorkspace* peaks = workspace->_peaks;
+
+    int next = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const float* bound = &slices[4 * i]; // First, last, min, max
+
+        float* x = &peaks->_x.front();
+        int* ind = &peaks->_ind.front();
+        int len = 1;
+
+        x[0] = bound[0];
+        ind[0] = 0;
+
+        // Indices are sorted, slice after slice
+        for (; next < extremaCount && (int)(extremaIndices[next] / imagePixels) == i; ++next)
+        {
+            x[len] = extremaValues[next];
+            ind[len] = (int)(extremaIndices[next] % imagePixels);
+            ++len;
+        }
+
+        x[len] = bound[1];
+        ind[len] = imagePixels - 1;
+        ++len;
+
+        const long long peaksTrace = beginHowlTrace();
+
+        const int found = pickPeaks(peaks, len, (float)((bound[3] - bound[2]) / 4.0));
+
+        endHowlTrace("findPeaks", peaksTrace);
+
+        float avgPeak = 0.0;
+
+        for (int k = 0; k < found; ++k)
+        {
+            avgPeak += peaks->_peakMags[k];
+        }
+
+        // A flat surface has no peaks, it is no match rather than 0 / 0
+        scores[i] = found > 0 ? avgPeak / found : 1.0f;
+    }
+
+    peaksNs = getHowlTimeNs() - start;
+#else
+    for (int i = 0; i < count; ++i)
+    {
+        scores[i] = 1.0f;
+    }
+#endif
+
+    return peaksNs;
+}
+
+float scoreMatchResult(MatchWorkspace* workspace, const float* result, int count)
+{
+    vector<float>& v = *workspace->_surface;
+
+    const long long trace = beginHowlTrace();
+
+    float mx = -FLT_MAX, mn = FLT_MAX;
+
+    for (int i = 0; i < count; ++i)
+    {
+        mx = result[i] > mx ? result[i] : mx;
+        mn = result[i] < mn ? result[i] : mn;
+    }
+
+    const float range = mx > mn ? mx - mn : 1.0f;
+
+    // Same as 1.0 - normalize(result) on the arrayfire path
+    for (int i = 0; i < count; ++i)
+    {
+        v[i] = 1.0f - (result[i] - mn) / range;
+    }
+
+    endHowlTrace("normalize", trace);
+
+    return averagePeak(workspace->_peaks, &v.front(), count);
+}
+
+static float averagePeak(PeakWorkspace* peaks, const float* surface, int count)
+{
+    const long long trace = beginHowlTrace();
+
+    const int found = findPeaksInto(surface, count, peaks);
+
+    endHowlTrace("findPeaks", trace);
+
+    float avgPeak = 0.0;
+
+    for (int i = 0; i < found; ++i)
+    {
+        avgPeak += peaks->_peakMags[i];
+    }
+
+    // A flat surface has no peaks, it is no match rather than 0 / 0
+    return found > 0 ? avgPeak / found : 1.0f;
+}
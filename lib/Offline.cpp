@@ -0,0 +1,175 @@
+// Offline.cpp
+#include "howl.h"
+#include "HowlContext.h"
+#include <new>
+#include <stdio.h>
+#include <sndfile.h>
+
+// One input stream, read through libsndfile or as raw float32
+struct OfflineReader
+{
+    SNDFILE*                _file;
+    FILE*                   _raw;
+    int                     _channels;
+    float*                  _frames;
+    bool                    _bEnd;
+};
+
+static int openOfflineReader(OfflineReader* reader, const char* path, int sampleRate, int chunkSamples);
+
+static int readOfflineReader(OfflineReader* reader, float* samples, int samplesSize);
+
+static void closeOfflineReader(OfflineReader* reader);
+
+long long runHowlLibOffline(
+    HowlLibContext* ctx,
+    const char* sourcePath,
+    const char* capturePath,
+    int chunkSamples
+)
+{
+    // Queued feeds could drop audio, offline runs the pipeline on this thread
+    if (!ctx || !ctx->_source._workspace || ctx->_analysis || ctx->_pair ||
+        !sourcePath || !capturePath || chunkSamples <= 0)
+    {
+        return -1;
+    }
+
+    OfflineReader source = {};
+    OfflineReader capture = {};
+
+    float* samples = new(std::nothrow) float[chunkSamples];
+
+    if (!samples ||
+        0 != openOfflineReader(&source, sourcePath, ctx->_sampleRate, chunkSamples) ||
+        0 != openOfflineReader(&capture, capturePath, ctx->_sampleRate, chunkSamples))
+    {
+        closeOfflineReader(&source);
+        closeOfflineReader(&capture);
+        delete [] samples;
+        return -1;
+    }
+
+    long long sourceSamples = 0;
+    long long captureSamples = 0;
+
+    // Same order as two realtime feeds of chunkSamples, results are deterministic
+    while (!source._bEnd || !capture._bEnd)
+    {
+        int samplesSize = readOfflineReader(&source, samples, chunkSamples);
+
+        if (samplesSize > 0)
+        {
+            feedSourceAudio(ctx, samples, samplesSize);
+            sourceSamples += samplesSize;
+        }
+
+        samplesSize = readOfflineReader(&capture, samples, chunkSamples);
+
+        if (samplesSize > 0)
+        {
+            feedCaptureAudio(ctx, samples, samplesSize);
+            captureSamples += samplesSize;
+        }
+    }
+
+    closeOfflineReader(&source);
+    closeOfflineReader(&capture);
+    delete [] samples;
+
+    return sourceSamples > captureSamples ? sourceSamples : captureSamples;
+}
+
+static int openOfflineReader(OfflineReader* reader, const char* path, int sampleRate, int chunkSamples)
+{
+    SF_INFO info = {};
+
+    reader->_file = sf_open(path, SFM_READ, &info);
+
+    if (reader->_file)
+    {
+        if (info.samplerate != sampleRate || info.channels <= 0)
+        {
+            fprintf(stderr, "%s: %d Hz, context runs at %d Hz\n", path, info.samplerate, sampleRate);
+            return -1;
+        }
+
+        reader->_channels = info.channels;
+        reader->_frames = new(std::nothrow) float[(size_t)chunkSamples * info.channels];
+
+        return reader->_frames ? 0 : -1;
+    }
+
+    // No header libsndfile knows, a raw dump
+    reader->_raw = fopen(path, "rb");
+
+    if (!reader->_raw)
+    {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+
+    reader->_channels = 1;
+
+    return 0;
+}
+
+static int readOfflineReader(OfflineReader* reader, float* samples, int samplesSize)
+{
+    if (reader->_bEnd)
+    {
+        return 0;
+    }
+
+    int count = 0;
+
+    if (reader->_raw)
+    {
+        count = (int)fread(samples, sizeof(float), samplesSize, reader->_raw);
+    }
+    else
+    {
+        const int channels = reader->_channels;
+
+        count = (int)sf_readf_float(reader->_file, reader->_frames, samplesSize);
+
+        // Downmix, the pipeline is mono
+        for (int i = 0; i < count; ++i)
+        {
+            float sum = 0.0f;
+
+            for (int c = 0; c < channels; ++c)
+            {
+                sum += reader->_frames[i * channels + c];
+            }
+
+            samples[i] = sum / channels;
+        }
+    }
+
+    if (count < samplesSize)
+    {
+        reader->_bEnd = true;
+    }
+
+    return count > 0 ? count : 0;
+}
+
+static void closeOfflineReader(OfflineReader* reader)
+{
+    if (reader->_file)
+    {
+        sf_close(reader->_file);
+    }
+
+    if (reader->_raw)
+    {
+        fclose(reader->_raw);
+    }
+
+    delete [] reader->_frames;
+
+    reader->_file = nullptr;
+    reader->_raw = nullptr;
+    reader->_frames = nullptr;
+}
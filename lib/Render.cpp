@@ -0,0 +1,362 @@
+#include "HowlContext.h"
+#include <new>
+#include <climits>
+
+SpectrumRender* createNewRender(int width, int height, int format)
+{
+    SpectrumRender* newRender = new (std::nothrow) SpectrumRender;
+
+    if (!newRender)
+    {
+        return NULL;
+    }
+
+    const int pixelSize = format == SPECTROGRAM_FORMAT_U8 ? sizeof(unsigned char) : sizeof(float);
+
+    newRender->_image = new (std::nothrow) unsigned char[width * height * pixelSize];
+
+    if (!newRender->_image)
+    {
+        delete newRender;
+        return NULL;
+    }
+
+    newRender->_format = format;
+    newRender->_width = width;
+    newRender->_height = height;
+    newRender->_position = 0;
+    newRender->_index = 0;
+    newRender->_fftOperand = nullptr;
+    newRender->_coarse = nullptr;
+    newRender->_refs.store(1, std::memory_order_relaxed);
+    newRender->_pool = nullptr;
+    newRender->_nextFree = nullptr;
+
+    return newRender;
+}
+
+static void destroyRender(SpectrumRender* render)
+{
+    destroyFftMatchOperand(render->_fftOperand);
+
+    delete [] render->_coarse;
+
+    delete [] render->_image;
+
+    delete render;
+}
+
+int initRenderPool(RenderPool* pool, int width, int height, int format, int count)
+{
+    pool->_free = nullptr;
+    pool->_width = width;
+    pool->_height = height;
+    pool->_format = format;
+    pool->_size = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        SpectrumRender* render = createNewRender(width, height, format);
+
+        if (!render)
+        {
+            return -1;
+        }
+
+        render->_pool = pool;
+        render->_nextFree = pool->_free;
+
+        pool->_free = render;
+        pool->_size++;
+    }
+
+    return 0;
+}
+
+void deinitRenderPool(RenderPool* pool)
+{
+    while (pool->_free)
+    {
+        SpectrumRender* render = pool->_free;
+
+        pool->_free = render->_nextFree;
+
+        destroyRender(render);
+    }
+
+    pool->_size = 0;
+}
+
+SpectrumRender* acquireRender(RenderPool* pool)
+{
+    SpectrumRender* render = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(pool->_mutex);
+
+        if (pool->_free)
+        {
+            render = pool->_free;
+            pool->_free = render->_nextFree;
+        }
+    }
+
+    if (!render)
+    {
+        // More renders alive than ever before, the pool grows by one
+        render = createNewRender(pool->_width, pool->_height, pool->_format);
+
+        if (!render)
+        {
+            return nullptr;
+        }
+
+        render->_pool = pool;
+
+        std::lock_guard<std::mutex> lock(pool->_mutex);
+
+        pool->_size++;
+    }
+
+    render->_nextFree = nullptr;
+    render->_refs.store(1, std::memory_order_relaxed);
+
+    return render;
+}
+
+void retainRender(SpectrumRender* render)
+{
+    render->_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void releaseRender(SpectrumRender* render)
+{
+    // Last reference may be held by the other stream's matcher
+    if (render->_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+    {
+        return;
+    }
+
+    RenderPool* pool = render->_pool;
+
+    if (!pool)
+    {
+        destroyRender(render);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pool->_mutex);
+
+    render->_nextFree = pool->_free;
+
+    pool->_free = render;
+}
+
+void fillRender(SpectrumRender* render, const StftStream* stft, float rangeDb)
+{
+    if (render->_format == SPECTROGRAM_FORMAT_U8)
+    {
+        getStftImageU8(
+            stft,
+            render->_image,
+            render->_width,
+            rangeDb
+        );
+    }
+    else
+    {
+        getStftImage(
+            stft,
+            (float*)render->_image,
+            render->_width
+        );
+    }
+}
+
+int initRenderHistory(RenderHistory* history, int capacity)
+{
+    history->_renders = new (std::nothrow) SpectrumRender*[capacity];
+    history->_capacity = capacity;
+    history->_head = 0;
+    history->_count = 0;
+
+    return history->_renders ? 0 : -1;
+}
+
+void deinitRenderHistory(RenderHistory* history)
+{
+    for (int i = 0; i < history->_count; ++i)
+    {
+        releaseRender(getHistoryRender(history, i));
+    }
+
+    delete [] history->_renders;
+
+    history->_renders = nullptr;
+    history->_count = 0;
+}
+
+SpectrumRender* pushRenderHistory(RenderHistory* history, SpectrumRender* render)
+{
+    SpectrumRender* evicted = nullptr;
+
+    if (history->_count == history->_capacity)
+    {
+        evicted = history->_renders[history->_head];
+
+        history->_head = (history->_head + 1) % history->_capacity;
+        history->_count--;
+    }
+
+    history->_renders[(history->_head + history->_count) % history->_capacity] = render;
+    history->_count++;
+
+    return evicted;
+}
+
+SpectrumRender* getHistoryRender(const RenderHistory* history, int index)
+{
+    return history->_renders[(history->_head + index) % history->_capacity];
+}
+
+// First render at or after position
+static int lowerRenderBound(const RenderHistory* history, long long position)
+{
+    int lo = 0;
+    int hi = history->_count;
+
+    while (lo < hi)
+    {
+        const int mid = (lo + hi) / 2;
+
+        if (getHistoryRender(history, mid)->_position < position)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int findRenderRange(const RenderHistory* history, long long first, long long last, int* index)
+{
+    const int begin = lowerRenderBound(history, first);
+    const int end = last < LLONG_MAX ? lowerRenderBound(history, last + 1) : history->_count;
+
+    *index = begin;
+
+    return end > begin ? end - begin : 0;
+}
+
+SpectrumRender* publishRender(HowlLibContext* ctx, HowlStream* stream, SpectrumRender* render, std::vector<SpectrumRender*>* snapshot)
+{
+    const bool bSource = stream == &ctx->_source;
+
+    HowlStream* other = bSource ? &ctx->_capture : &ctx->_source;
+
+    long long alignment = ctx->_alignment.load(std::memory_order_relaxed);
+    long long minLag = ctx->_minLag;
+    long long maxLag = ctx->_maxLag;
+
+    if (ctx->_loopDelay)
+    {
+        const long long delay = ctx->_loopDelay->_delay.load(std::memory_order_relaxed);
+
+        // No coherent path, nothing to match. Otherwise only the render nearest to the delay
+        alignment = delay != LLONG_MIN ? delay : 0;
+        minLag = delay != LLONG_MIN ? -ctx->_snapshotHop / 2 : 1;
+        maxLag = delay != LLONG_MIN ? ctx->_snapshotHop / 2 : 0;
+    }
+
+    // Capture position minus aligned source position must be within the lag range
+    const long long first = bSource ?
+        render->_position + alignment + minLag :
+        render->_position - alignment - maxLag;
+    const long long last = bSource ?
+        render->_position + alignment + maxLag :
+        render->_position - alignment - minLag;
+
+    std::lock_guard<std::mutex> lock(*ctx->_rendersMutex);
+
+    SpectrumRender* evicted = pushRenderHistory(stream->_renders, render);
+
+    // Only pointers are copied under the lock, matching runs on the snapshot
+    snapshot->clear();
+
+    int index = 0;
+
+    const int count = findRenderRange(other->_renders, first, last, &index);
+
+    for (int i = index; i < index + count; ++i)
+    {
+        SpectrumRender* r = getHistoryRender(other->_renders, i);
+
+        retainRender(r);
+
+        snapshot->push_back(r);
+    }
+
+    ctx->_stats._pairsSkipped.fetch_add(other->_renders->_count - count, std::memory_order_relaxed);
+
+    // Freed outside the lock, or later by whoever still holds a snapshot
+    return evicted;
+}
+
+void releaseRenderSnapshot(std::vector<SpectrumRender*>* snapshot)
+{
+    for (int i = 0; i < (int)snapshot->size(); ++i)
+    {
+        releaseRender(snapshot->at(i));
+    }
+
+    snapshot->clear();
+}
+
+int fillCoarseRender(SpectrumRender* render, int levels)
+{
+    const int block = 1 << levels;
+    const int coarseWidth = render->_width >> levels;
+    const int coarseHeight = render->_height >> levels;
+
+    if (!render->_coarse)
+    {
+        render->_coarse = new (std::nothrow) float[coarseWidth * coarseHeight];
+    }
+
+    if (!render->_coarse)
+    {
+        return -1;
+    }
+
+    const bool bU8 = render->_format == SPECTROGRAM_FORMAT_U8;
+    const unsigned char* u8 = render->_image;
+    const float* f32 = (const float*)render->_image;
+    const float scale = 1.0f / (block * block);
+
+    // Trailing rows and columns that do not fill a block are left out
+    for (int y = 0; y < coarseHeight; ++y)
+    {
+        for (int x = 0; x < coarseWidth; ++x)
+        {
+            float sum = 0.0f;
+
+            for (int by = y * block; by < (y + 1) * block; ++by)
+            {
+                const int row = by * render->_width;
+
+                for (int bx = x * block; bx < (x + 1) * block; ++bx)
+                {
+                    sum += bU8 ? (float)u8[row + bx] : f32[row + bx];
+                }
+            }
+
+            render->_coarse[y * coarseWidth + x] = sum * scale;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+// SampleQueue.cpp
+#include "SampleQueue.h"
+#include <new>
+#include <cstring>
+
+int initSampleQueue(SampleQueue* queue, int capacity)
+{
+    if (!queue || capacity <= 0)
+    {
+        return -1;
+    }
+
+    int size = 1;
+
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    queue->_data = new(std::nothrow) float[size];
+
+    if (!queue->_data)
+    {
+        return -1;
+    }
+
+    queue->_mask = size - 1;
+    queue->_head.store(0, std::memory_order_relaxed);
+    queue->_tail.store(0, std::memory_order_relaxed);
+    queue->_gap.store(0, std::memory_order_relaxed);
+
+    return 0;
+}
+
+void deinitSampleQueue(SampleQueue* queue)
+{
+    if (!queue)
+    {
+        return;
+    }
+
+    delete [] queue->_data;
+
+    queue->_data = nullptr;
+    queue->_mask = 0;
+}
+
+bool pushSampleQueue(SampleQueue* queue, const float* samples, int samplesSize)
+{
+    const long long tail = queue->_tail.load(std::memory_order_relaxed);
+    const long long head = queue->_head.load(std::memory_order_acquire);
+    const int capacity = queue->_mask + 1;
+
+    // Only the producer grows the gap, nothing is queued behind it
+    if (queue->_gap.load(std::memory_order_acquire) > 0 || tail - head + samplesSize > capacity)
+    {
+        queue->_gap.fetch_add(samplesSize, std::memory_order_acq_rel);
+        return false;
+    }
+
+    int pos = (int)(tail & queue->_mask);
+    int first = capacity - pos < samplesSize ? capacity - pos : samplesSize;
+
+    memcpy(queue->_data + pos, samples, sizeof(float) * first);
+    memcpy(queue->_data, samples + first, sizeof(float) * (samplesSize - first));
+
+    queue->_tail.store(tail + samplesSize, std::memory_order_release);
+
+    return true;
+}
+
+int popSampleQueue(SampleQueue* queue, float* out, int maxSamples)
+{
+    const long long head = queue->_head.load(std::memory_order_relaxed);
+    const long long tail = queue->_tail.load(std::memory_order_acquire);
+    const int capacity = queue->_mask + 1;
+
+    int count = (int)(tail - head);
+
+    if (count > maxSamples)
+    {
+        count = maxSamples;
+    }
+
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    int pos = (int)(head & queue->_mask);
+    int first = capacity - pos < count ? capacity - pos : count;
+
+    memcpy(out, queue->_data + pos, sizeof(float) * first);
+    memcpy(out + first, queue->_data, sizeof(float) * (count - first));
+
+    queue->_head.store(head + count, std::memory_order_release);
+
+    return count;
+}
+
+int skipSampleQueue(SampleQueue* queue, int maxSamples)
+{
+    const long long head = queue->_head.load(std::memory_order_relaxed);
+    const long long tail = queue->_tail.load(std::memory_order_acquire);
+
+    int count = (int)(tail - head);
+
+    if (count > maxSamples)
+    {
+        count = maxSamples;
+    }
+
+    if (count <= 0)
+    {
+        return 0;
+    }
+
+    queue->_head.store(head + count, std::memory_order_release);
+
+    return count;
+}
+
+int getSampleQueueSize(const SampleQueue* queue)
+{
+    return (int)(queue->_tail.load(std::memory_order_acquire) -
+                 queue->_head.load(std::memory_order_acquire));
+}
+
+long long takeSampleQueueGap(SampleQueue* queue)
+{
+    // Samples queued before the gap come first
+    if (getSampleQueueSize(queue) > 0)
+    {
+        return 0;
+    }
+
+    return queue->_gap.exchange(0, std::memory_order_acq_rel);
+}
+
+long long getSampleQueueGap(const SampleQueue* queue)
+{
+    return queue->_gap.load(std::memory_order_acquire);
+}
@@ -0,0 +1,42 @@
+// SampleQueue.h
+#ifndef SAMPLEQUEUE_H
+#define SAMPLEQUEUE_H
+
+#include <atomic>
+
+/**
+ * Bounded lock-free single producer / single consumer sample FIFO.
+ * Capacity is rounded up to a power of two. Refused samples are counted
+ * as a gap behind everything queued: later pushes are refused too until
+ * the consumer has emptied the queue and taken the gap.
+ */
+struct SampleQueue
+{
+    float*                  _data;
+    int                     _mask;
+    std::atomic<long long>  _head;
+    std::atomic<long long>  _tail;
+    std::atomic<long long>  _gap;
+};
+
+int initSampleQueue(SampleQueue* queue, int capacity);
+
+void deinitSampleQueue(SampleQueue* queue);
+
+// All or nothing, false when the samples do not fit or a gap is pending, they join the gap
+bool pushSampleQueue(SampleQueue* queue, const float* samples, int samplesSize);
+
+// Returns the number of samples copied to out
+int popSampleQueue(SampleQueue* queue, float* out, int maxSamples);
+
+// Consumer side, drops up to maxSamples of the oldest samples
+int skipSampleQueue(SampleQueue* queue, int maxSamples);
+
+int getSampleQueueSize(const SampleQueue* queue);
+
+// Consumer side, the samples refused since the last call once the queue is empty, else 0
+long long takeSampleQueueGap(SampleQueue* queue);
+
+long long getSampleQueueGap(const SampleQueue* queue);
+
+#endif
@@ -0,0 +1,209 @@
+// Stats.cpp
+#include "howl.h"
+#include "HowlContext.h"
+#include <new>
+#include <chrono>
+
+static void resetHistogram(StatsHistogram* histogram);
+
+static void readHistogram(const StatsHistogram* histogram, HowlLatencyHistogram* out);
+
+long long getHowlTimeNs()
+{
+    return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void resetHowlStats(HowlStats* stats)
+{
+    stats->_sourceSamples.store(0);
+    stats->_captureSamples.store(0);
+    stats->_droppedSamples.store(0);
+    stats->_lateSamples.store(0);
+    stats->_snapshots.store(0);
+    stats->_silentSnapshots.store(0);
+    stats->_pairsScored.store(0);
+    stats->_pairsSkipped.store(0);
+    stats->_pairsCoarse.store(0);
+    stats->_matches.store(0);
+    stats->_errors.store(0);
+    stats->_incoherentSnapshots.store(0);
+    stats->_landmarks.store(0);
+    stats->_earlyDetections.store(0);
+    stats->_unflaggedSnapshots.store(0);
+
+    resetHistogram(&stats->_spectrogram);
+    resetHistogram(&stats->_matching);
+    resetHistogram(&stats->_peaks);
+    resetHistogram(&stats->_detection);
+    resetHistogram(&stats->_feed);
+}
+
+void recordHowlStat(StatsHistogram* histogram, long long ns)
+{
+    const long long us = ns > 0 ? ns / 1000 : 0;
+
+    int bucket = 0;
+
+    while (bucket < HOWL_STATS_BUCKETS - 1 && (1LL << bucket) <= us)
+    {
+        ++bucket;
+    }
+
+    histogram->_count.fetch_add(1, std::memory_order_relaxed);
+    histogram->_totalUs.fetch_add(us, std::memory_order_relaxed);
+    histogram->_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    long long maxUs = histogram->_maxUs.load(std::memory_order_relaxed);
+
+    while (us > maxUs &&
+           !histogram->_maxUs.compare_exchange_weak(maxUs, us, std::memory_order_relaxed))
+    {
+    }
+}
+
+int getHowlLibStats(
+    HowlLibContext* ctx,
+    HowlLibStats* out
+)
+{
+    if (!ctx || !out)
+    {
+        return -1;
+    }
+
+    const HowlStats& stats = ctx->_stats;
+
+    out->_sourceSamples = stats._sourceSamples.load(std::memory_order_relaxed);
+    out->_captureSamples = stats._captureSamples.load(std::memory_order_relaxed);
+    out->_droppedSamples = stats._droppedSamples.load(std::memory_order_relaxed);
+    out->_lateSamples = stats._lateSamples.load(std::memory_order_relaxed);
+    out->_snapshots = stats._snapshots.load(std::memory_order_relaxed);
+    out->_silentSnapshots = stats._silentSnapshots.load(std::memory_order_relaxed);
+    out->_pairsScored = stats._pairsScored.load(std::memory_order_relaxed);
+    out->_pairsSkipped = stats._pairsSkipped.load(std::memory_order_relaxed);
+    out->_pairsCoarse = stats._pairsCoarse.load(std::memory_order_relaxed);
+    out->_matches = stats._matches.load(std::memory_order_relaxed);
+    out->_errors = stats._errors.load(std::memory_order_relaxed);
+    out->_incoherentSnapshots = stats._incoherentSnapshots.load(std::memory_order_relaxed);
+    out->_loopDelaySamples = ctx->_loopDelay ? ctx->_loopDelay->_estimate.load(std::memory_order_relaxed) : 0;
+    out->_loopDelayCoherence = ctx->_loopDelay ? ctx->_loopDelay->_coherence.load(std::memory_order_relaxed) : 0.0f;
+    out->_landmarks = stats._landmarks.load(std::memory_order_relaxed);
+    out->_earlyDetections = stats._earlyDetections.load(std::memory_order_relaxed);
+    out->_unflaggedSnapshots = stats._unflaggedSnapshots.load(std::memory_order_relaxed);
+
+    readHistogram(&stats._spectrogram, &out->_spectrogram);
+    readHistogram(&stats._matching, &out->_matching);
+    readHistogram(&stats._peaks, &out->_peaks);
+    readHistogram(&stats._detection, &out->_detection);
+    readHistogram(&stats._feed, &out->_feed);
+
+    return 0;
+}
+
+StreamArrivals* createStreamArrivals()
+{
+    StreamArrivals* arrivals = new(std::nothrow) StreamArrivals;
+
+    if (!arrivals)
+    {
+        return nullptr;
+    }
+
+    for (int i = 0; i < ARRIVAL_STAMPS; ++i)
+    {
+        arrivals->_stamps[i]._end.store(0);
+        arrivals->_stamps[i]._timeNs.store(0);
+    }
+
+    arrivals->_count.store(0);
+    arrivals->_fed = 0;
+    arrivals->_read = 0;
+
+    return arrivals;
+}
+
+void stampStreamArrival(StreamArrivals* arrivals, int samplesSize, long long timeNs)
+{
+    const long long count = arrivals->_count.load(std::memory_order_relaxed);
+
+    ArrivalStamp& stamp = arrivals->_stamps[count % ARRIVAL_STAMPS];
+
+    arrivals->_fed += samplesSize;
+
+    stamp._end.store(arrivals->_fed, std::memory_order_relaxed);
+    stamp._timeNs.store(timeNs, std::memory_order_relaxed);
+
+    arrivals->_count.store(count + 1, std::memory_order_release);
+}
+
+long long getStreamArrival(StreamArrivals* arrivals, long long position, long long* end)
+{
+    // Dropped audio still advances the ring, positions are fed samples
+    const long long fed = position;
+
+    for (;;)
+    {
+        const long long count = arrivals->_count.load(std::memory_order_acquire);
+
+        // Older stamps are overwritten, the oldest slot is the one the next feed writes
+        if (arrivals->_read < count - (ARRIVAL_STAMPS - 1))
+        {
+            arrivals->_read = count - (ARRIVAL_STAMPS - 1);
+        }
+
+        // The feed is stamped right after its samples are queued, it can still be missing
+        if (arrivals->_read >= count)
+        {
+            return -1;
+        }
+
+        const ArrivalStamp& stamp = arrivals->_stamps[arrivals->_read % ARRIVAL_STAMPS];
+
+        const long long feedEnd = stamp._end.load(std::memory_order_relaxed);
+        const long long timeNs = stamp._timeNs.load(std::memory_order_relaxed);
+
+        // Overwritten while it was read
+        if (arrivals->_count.load(std::memory_order_acquire) - arrivals->_read > ARRIVAL_STAMPS - 1)
+        {
+            continue;
+        }
+
+        if (feedEnd >= fed)
+        {
+            if (end)
+            {
+                *end = feedEnd;
+            }
+
+            // Later renders of the same feed find it again
+            return timeNs;
+        }
+
+        arrivals->_read++;
+    }
+}
+
+static void resetHistogram(StatsHistogram* histogram)
+{
+    histogram->_count.store(0);
+    histogram->_totalUs.store(0);
+    histogram->_maxUs.store(0);
+
+    for (int i = 0; i < HOWL_STATS_BUCKETS; ++i)
+    {
+        histogram->_buckets[i].store(0);
+    }
+}
+
+static void readHistogram(const StatsHistogram* histogram, HowlLatencyHistogram* out)
+{
+    out->_count = histogram->_count.load(std::memory_order_relaxed);
+    out->_totalUs = histogram->_totalUs.load(std::memory_order_relaxed);
+    out->_maxUs = histogram->_maxUs.load(std::memory_order_relaxed);
+
+    for (int i = 0; i < HOWL_STATS_BUCKETS; ++i)
+    {
+        out->_buckets[i] = histogram->_buckets[i].load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,251 @@
+// Stft.cpp
+#include "Stft.h"
+#include <new>
+#include <cmath>
+#include <cstring>
+
+#define STFT_MIN_MAGNITUDE 1e-9f
+
+int initStftStream(StftStream* stft, const FftPlan* plan, int windowSize, int frames, int bands)
+{
+    if (!stft || !plan || frames <= 0 || bands <= 0 || windowSize < frames)
+    {
+        return -1;
+    }
+
+    memset(stft, 0, sizeof(StftStream));
+
+    stft->_plan = plan;
+    stft->_frames = frames;
+    stft->_bands = bands;
+    stft->_hopSize = windowSize / frames;
+    stft->_bins = plan->_bins;
+
+    if (plan->_size != getFftSizeForHop(stft->_hopSize))
+    {
+        return -1;
+    }
+
+    stft->_bandEdges = new(std::nothrow) int[bands + 1];
+    stft->_columns = new(std::nothrow) float[2 * frames * stft->_bins];
+    stft->_columnPeaks = new(std::nothrow) float[2 * frames];
+
+    if (!stft->_bandEdges ||
+        !stft->_columns ||
+        !stft->_columnPeaks ||
+        0 != allocFftWorkspace(plan, &stft->_frame, &stft->_spectrum))
+    {
+        deinitStftStream(stft);
+        return -1;
+    }
+
+    memset(stft->_columns, 0, sizeof(float) * 2 * frames * stft->_bins);
+    memset(stft->_columnPeaks, 0, sizeof(float) * 2 * frames);
+
+    // DC bin is skipped, remaining bins are split linearly into bands
+    const int bandBins = stft->_bins - 1;
+
+    for (int y = 0; y <= bands; ++y)
+    {
+        stft->_bandEdges[y] = 1 + y * bandBins / bands;
+    }
+
+    for (int y = 0; y < bands; ++y)
+    {
+        if (stft->_bandEdges[y + 1] <= stft->_bandEdges[y])
+        {
+            stft->_bandEdges[y + 1] = stft->_bandEdges[y] + 1;
+        }
+    }
+
+    // More bands than bins
+    if (stft->_bandEdges[bands] > stft->_bins)
+    {
+        deinitStftStream(stft);
+        return -1;
+    }
+
+    stft->_nextFrameEnd = plan->_size;
+    stft->_columnCount = 0;
+
+    return 0;
+}
+
+void deinitStftStream(StftStream* stft)
+{
+    if (!stft)
+    {
+        return;
+    }
+
+    freeFftWorkspace(stft->_frame, stft->_spectrum);
+
+    delete [] stft->_bandEdges;
+    delete [] stft->_columns;
+    delete [] stft->_columnPeaks;
+
+    memset(stft, 0, sizeof(StftStream));
+}
+
+static void appendColumn(StftStream* stft)
+{
+    const int bins = stft->_bins;
+    const int pos = (int)(stft->_columnCount % stft->_frames);
+
+    float* low = stft->_columns + pos * bins;
+    float* high = low + stft->_frames * bins;
+
+    float peak = 0;
+
+    for (int i = 0; i < bins; ++i)
+    {
+        const double re = stft->_spectrum[i][0];
+        const double im = stft->_spectrum[i][1];
+        const float magnitude = (float)sqrt(re * re + im * im);
+
+        low[i] = high[i] = magnitude;
+
+        // DC offset is not sound
+        if (i > 0 && magnitude > peak)
+        {
+            peak = magnitude;
+        }
+    }
+
+    stft->_columnPeaks[pos] = stft->_columnPeaks[pos + stft->_frames] = peak;
+    stft->_columnCount++;
+}
+
+int updateStftStream(StftStream* stft, const AudioRing* ring)
+{
+    const long long written = getAudioRingPosition(ring);
+
+    int added = 0;
+
+    while (stft->_nextFrameEnd <= written)
+    {
+        const int fftSize = stft->_plan->_size;
+        const double* samples = getAudioRingSamples(
+            ring,
+            stft->_nextFrameEnd - fftSize,
+            fftSize);
+
+        if (samples)
+        {
+            const double* window = stft->_plan->_window;
+
+            for (int i = 0; i < fftSize; ++i)
+            {
+                stft->_frame[i] = samples[i] * window[i];
+            }
+
+            executeFftPlan(stft->_plan, stft->_frame, stft->_spectrum);
+        }
+        else
+        {
+            // Frames that already left the ring can not be transformed anymore, they count as silence
+            memset(stft->_spectrum, 0, sizeof(fftw_complex) * stft->_bins);
+        }
+
+        appendColumn(stft);
+
+        added++;
+
+        stft->_nextFrameEnd += stft->_hopSize;
+    }
+
+    return added;
+}
+
+bool hasStftWindow(const StftStream* stft)
+{
+    return stft->_columnCount >= stft->_frames;
+}
+
+const float* getStftColumns(const StftStream* stft)
+{
+    return stft->_columns + (int)(stft->_columnCount % stft->_frames) * stft->_bins;
+}
+
+const float* getStftNewestColumns(const StftStream* stft, int count)
+{
+    return stft->_columns + (int)((stft->_columnCount - count) % stft->_frames) * stft->_bins;
+}
+
+float getStftPeak(const StftStream* stft)
+{
+    const float* peaks = stft->_columnPeaks + (int)(stft->_columnCount % stft->_frames);
+
+    float peak = 0;
+
+    for (int i = 0; i < stft->_frames; ++i)
+    {
+        if (peaks[i] > peak)
+        {
+            peak = peaks[i];
+        }
+    }
+
+    return peak;
+}
+
+static float bandMagnitude(const StftStream* stft, const float* column, int band)
+{
+    const int last = stft->_bandEdges[band + 1];
+
+    float magnitude = STFT_MIN_MAGNITUDE;
+
+    for (int b = stft->_bandEdges[band]; b < last; ++b)
+    {
+        if (column[b] > magnitude)
+        {
+            magnitude = column[b];
+        }
+    }
+
+    return magnitude;
+}
+
+void getStftImage(const StftStream* stft, float* image, int width)
+{
+    const float* columns = getStftColumns(stft);
+
+    for (int x = 0; x < width; ++x)
+    {
+        const float* column = columns + (x * stft->_frames / width) * stft->_bins;
+
+        for (int y = 0; y < stft->_bands; ++y)
+        {
+            image[y * width + x] = 20.0f * log10f(bandMagnitude(stft, column, y));
+        }
+    }
+}
+
+void getStftImageU8(const StftStream* stft, unsigned char* image, int width, float rangeDb)
+{
+    const float* columns = getStftColumns(stft);
+    // Relative to the loudest bin so gain differences between streams cancel out
+    const float topDb = 20.0f * log10f(fmaxf(getStftPeak(stft), STFT_MIN_MAGNITUDE));
+    const float scale = 255.0f / rangeDb;
+
+    for (int x = 0; x < width; ++x)
+    {
+        const float* column = columns + (x * stft->_frames / width) * stft->_bins;
+
+        for (int y = 0; y < stft->_bands; ++y)
+        {
+            float level = (20.0f * log10f(bandMagnitude(stft, column, y)) - topDb + rangeDb) * scale;
+
+            if (level < 0)
+            {
+                level = 0;
+            }
+            else if (level > 255.0f)
+            {
+                level = 255.0f;
+            }
+
+            image[y * width + x] = (unsigned char)(level + 0.5f);
+        }
+    }
+}
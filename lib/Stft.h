@@ -0,0 +1,55 @@
+// Stft.h
+#ifndef STFT_H
+#define STFT_H
+
+#include "AudioRing.h"
+#include "FftPlan.h"
+
+/**
+ * Streaming short time fourier transform.
+ * Only the hops that arrived since the last update are transformed,
+ * magnitudes are appended to a rolling matrix of _frames columns
+ * (double-written like AudioRing so the window is contiguous).
+ * Plan and window come from the context, band edges of the image are
+ * computed once at init so a snapshot only reads columns.
+ */
+struct StftStream
+{
+    const FftPlan*  _plan;
+    int             _hopSize;
+    int             _bins;
+    int             _frames;
+    int             _bands;
+    int*            _bandEdges;
+    double*         _frame;
+    fftw_complex*   _spectrum;
+    float*          _columns;
+    float*          _columnPeaks;
+    long long       _nextFrameEnd;
+    long long       _columnCount;
+};
+
+int initStftStream(StftStream* stft, const FftPlan* plan, int windowSize, int frames, int bands);
+
+void deinitStftStream(StftStream* stft);
+
+// Transforms every complete hop available in ring, frames that already left it are appended silent. Returns new columns
+int updateStftStream(StftStream* stft, const AudioRing* ring);
+
+bool hasStftWindow(const StftStream* stft);
+
+// Oldest column of the window, _frames * _bins magnitudes
+const float* getStftColumns(const StftStream* stft);
+
+// Oldest of the last count columns, count at most _frames
+const float* getStftNewestColumns(const StftStream* stft, int count);
+
+float getStftPeak(const StftStream* stft);
+
+// Row major image (row = frequency band, dB scaled) of the current window
+void getStftImage(const StftStream* stft, float* image, int width);
+
+// Same bands quantized to 8 bits over rangeDb below the window peak
+void getStftImageU8(const StftStream* stft, unsigned char* image, int width, float rangeDb);
+
+#endif
@@ -0,0 +1,398 @@
+// Trace.cpp
+#include "howl.h"
+#include "HowlContext.h"
+#include <new>
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// Spans per thread waiting for the flush, more are dropped
+#define TRACE_EVENTS 16384
+#define TRACE_FLUSH_MS 100
+// Buffers ready for threads tracing their first span, refilled by the flush
+#define TRACE_SPARE_BUFFERS 8
+
+struct TraceEvent
+{
+    const char*             _name;
+    long long               _start;
+    long long               _end;
+};
+
+// Single producer (its thread) / single consumer (the flush)
+struct TraceBuffer
+{
+    TraceEvent              _events[TRACE_EVENTS];
+    std::atomic<long long>  _head;
+    std::atomic<long long>  _tail;
+    int                     _tid;
+    bool                    _bExited; // Owner thread is gone, freed once flushed
+    TraceBuffer*            _next;
+};
+
+struct Tracer
+{
+    ~Tracer();
+
+    std::mutex              _mutex; // Buffer lists, file and start/stop
+    std::condition_variable _cond;
+    TraceBuffer*            _buffers;
+    TraceBuffer*            _spares; // Only while a trace runs
+    int                     _spareCount;
+    int                     _threads;
+    FILE*                   _file;
+    std::thread             _flusher;
+    bool                    _quit;
+    bool                    _bFirst;
+    long long               _origin;
+    std::atomic<long long>  _dropped;
+};
+
+std::atomic<bool> howlTraceEnabled(false);
+
+static Tracer tracer;
+
+// A thread keeps its buffer across traces
+static thread_local TraceBuffer* threadBuffer = nullptr;
+
+// Releases the buffer of an exiting thread, kept apart so threadBuffer stays trivially destructible
+struct TraceThreadExit
+{
+    ~TraceThreadExit();
+};
+
+static thread_local TraceThreadExit threadExit;
+
+static TraceBuffer* registerTraceThread();
+
+static void flushLoop();
+
+static void flushTraceBuffers();
+
+static void freeExitedTraceBuffers();
+
+static TraceBuffer* createTraceBuffers(int count);
+
+static void addSpareTraceBuffers(TraceBuffer* spares);
+
+static void freeTraceBuffers(TraceBuffer* buffers);
+
+int startHowlLibTrace(
+    const char* path
+)
+{
+    if (!path)
+    {
+        return -1;
+    }
+
+    // Allocated here, traced threads take them without allocating
+    TraceBuffer* spares = createTraceBuffers(TRACE_SPARE_BUFFERS);
+
+    std::lock_guard<std::mutex> lock(tracer._mutex);
+
+    if (tracer._file)
+    {
+        freeTraceBuffers(spares);
+        return -1;
+    }
+
+    tracer._file = fopen(path, "w");
+
+    if (!tracer._file)
+    {
+        freeTraceBuffers(spares);
+        return -1;
+    }
+
+    addSpareTraceBuffers(spares);
+
+    // Spans that ended after the last stop belong to no trace
+    for (TraceBuffer* buffer = tracer._buffers; buffer; buffer = buffer->_next)
+    {
+        buffer->_tail.store(buffer->_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    fprintf(tracer._file, "{\"traceEvents\":[\n");
+
+    tracer._bFirst = true;
+    tracer._quit = false;
+    tracer._origin = getHowlTimeNs();
+    tracer._dropped.store(0);
+    tracer._flusher = std::thread(flushLoop);
+
+    howlTraceEnabled.store(true, std::memory_order_release);
+
+    return 0;
+}
+
+void stopHowlLibTrace()
+{
+    std::unique_lock<std::mutex> lock(tracer._mutex);
+
+    if (!tracer._file)
+    {
+        return;
+    }
+
+    howlTraceEnabled.store(false, std::memory_order_release);
+
+    tracer._quit = true;
+    tracer._cond.notify_one();
+
+    lock.unlock();
+
+    tracer._flusher.join();
+
+    lock.lock();
+
+    flushTraceBuffers();
+    freeExitedTraceBuffers();
+
+    fprintf(tracer._file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%lld}}\n", tracer._dropped.load());
+
+    fclose(tracer._file);
+
+    tracer._file = nullptr;
+
+    freeTraceBuffers(tracer._spares);
+
+    tracer._spares = nullptr;
+    tracer._spareCount = 0;
+}
+
+// A trace left running at exit is finished, a joinable flusher would terminate the process
+Tracer::~Tracer()
+{
+    stopHowlLibTrace();
+}
+
+void endHowlTrace(const char* name, long long start)
+{
+    if (start == 0)
+    {
+        return;
+    }
+
+    const long long end = getHowlTimeNs();
+
+    TraceBuffer* buffer = threadBuffer ? threadBuffer : registerTraceThread();
+
+    if (!buffer)
+    {
+        return;
+    }
+
+    const long long head = buffer->_head.load(std::memory_order_relaxed);
+
+    // Never waits on the flush, a full buffer loses the span
+    if (head - buffer->_tail.load(std::memory_order_acquire) >= TRACE_EVENTS)
+    {
+        tracer._dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent& event = buffer->_events[head % TRACE_EVENTS];
+
+    event._name = name;
+    event._start = start;
+    event._end = end;
+
+    buffer->_head.store(head + 1, std::memory_order_release);
+}
+
+static TraceBuffer* registerTraceThread()
+{
+    // Audio threads trace too, a busy tracer or no spare loses the span rather than waiting
+    std::unique_lock<std::mutex> lock(tracer._mutex, std::try_to_lock);
+
+    if (!lock.owns_lock() || !tracer._spares)
+    {
+        tracer._dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    TraceBuffer* buffer = tracer._spares;
+
+    tracer._spares = buffer->_next;
+    tracer._spareCount--;
+
+    buffer->_head.store(0);
+    buffer->_tail.store(0);
+    buffer->_bExited = false;
+    buffer->_tid = ++tracer._threads;
+    buffer->_next = tracer._buffers;
+
+    tracer._buffers = buffer;
+
+    threadBuffer = buffer;
+
+    // First use constructs it, its destructor runs when this thread exits
+    (void)&threadExit;
+
+    return buffer;
+}
+
+TraceThreadExit::~TraceThreadExit()
+{
+    TraceBuffer* buffer = threadBuffer;
+
+    if (!buffer)
+    {
+        return;
+    }
+
+    threadBuffer = nullptr;
+
+    std::lock_guard<std::mutex> lock(tracer._mutex);
+
+    buffer->_bExited = true;
+
+    // Spans still waiting are written by the flush first
+    if (!tracer._file)
+    {
+        freeExitedTraceBuffers();
+    }
+}
+
+static void flushLoop()
+{
+    std::unique_lock<std::mutex> lock(tracer._mutex);
+
+    while (!tracer._quit)
+    {
+        tracer._cond.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_MS));
+
+        flushTraceBuffers();
+        freeExitedTraceBuffers();
+
+        // Spares taken since are replaced here, off the traced threads
+        const int missing = TRACE_SPARE_BUFFERS - tracer._spareCount;
+
+        if (missing > 0)
+        {
+            lock.unlock();
+
+            TraceBuffer* spares = createTraceBuffers(missing);
+
+            lock.lock();
+
+            addSpareTraceBuffers(spares);
+        }
+    }
+}
+
+// Called with the tracer mutex held
+static void flushTraceBuffers()
+{
+    for (TraceBuffer* buffer = tracer._buffers; buffer; buffer = buffer->_next)
+    {
+        const long long head = buffer->_head.load(std::memory_order_acquire);
+
+        long long tail = buffer->_tail.load(std::memory_order_relaxed);
+
+        for (; tail < head; ++tail)
+        {
+            const TraceEvent& event = buffer->_events[tail % TRACE_EVENTS];
+
+            // Begun during an earlier trace
+            if (event._start < tracer._origin)
+            {
+                continue;
+            }
+
+            // Complete events, begin and end of a span in one record
+            fprintf(tracer._file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    tracer._bFirst ? "" : ",\n",
+                    event._name,
+                    buffer->_tid,
+                    (event._start - tracer._origin) / 1000.0,
+                    (event._end - event._start) / 1000.0);
+
+            tracer._bFirst = false;
+        }
+
+        buffer->_tail.store(tail, std::memory_order_release);
+    }
+
+    fflush(tracer._file);
+}
+
+// Called with the tracer mutex held, after a flush. They become spares while a trace runs.
+static void freeExitedTraceBuffers()
+{
+    TraceBuffer** link = &tracer._buffers;
+
+    while (*link)
+    {
+        TraceBuffer* buffer = *link;
+
+        if (!buffer->_bExited)
+        {
+            link = &buffer->_next;
+            continue;
+        }
+
+        *link = buffer->_next;
+
+        if (tracer._file && tracer._spareCount < TRACE_SPARE_BUFFERS)
+        {
+            buffer->_next = nullptr;
+            addSpareTraceBuffers(buffer);
+        }
+        else
+        {
+            delete buffer;
+        }
+    }
+}
+
+// Linked by _next, fewer than count when memory runs out
+static TraceBuffer* createTraceBuffers(int count)
+{
+    TraceBuffer* buffers = nullptr;
+
+    for (int i = 0; i < count; ++i)
+    {
+        TraceBuffer* buffer = new(std::nothrow) TraceBuffer;
+
+        if (!buffer)
+        {
+            break;
+        }
+
+        buffer->_next = buffers;
+        buffers = buffer;
+    }
+
+    return buffers;
+}
+
+// Called with the tracer mutex held
+static void addSpareTraceBuffers(TraceBuffer* spares)
+{
+    while (spares)
+    {
+        TraceBuffer* buffer = spares;
+
+        spares = buffer->_next;
+
+        buffer->_next = tracer._spares;
+        tracer._spares = buffer;
+        tracer._spareCount++;
+    }
+}
+
+static void freeTraceBuffers(TraceBuffer* buffers)
+{
+    while (buffers)
+    {
+        TraceBuffer* buffer = buffers;
+
+        buffers = buffer->_next;
+
+        delete buffer;
+    }
+}
@@ -1,6 +1,11 @@
 // Util.cpp
 #include "Util.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PEAKS_X86
+#include <immintrin.h>
+#endif
+
 
 void diff(vector<float> in, vector<float>& out)
 {
@@ -31,27 +36,6 @@ void selectElements(vector<float> in, vector<int> indices, vector<float>& out)
 		out.push_back(in[indices[i]]);
 }
 
-void selectElements(vector<int> in, vector<int> indices, vector<int>& out)
-{
-	for(int i=0; i<indices.size(); ++i)
-		out.push_back(in[indices[i]]);
-}
-
-void signVector(vector<float> in, vector<int>& out)
-{
-	out = vector<int>(in.size());
-
-	for(int i=0; i<in.size(); ++i)
-	{
-		if(in[i]>0)
-			out[i]=1;
-		else if(in[i]<0)
-			out[i]=-1;
-		else
-			out[i]=0;
-	}
-}
-
 
 void findPeaks(const vector<float>& x0, vector<int>& peakInds)
 {
@@ -83,124 +67,249 @@ void findPeaks(const vector<float>& x0, vector<int>& peakInds)
 
 
 	ind.insert(ind.begin(), 0);
-	ind.insert(ind.end(), len0);
-
-	int minMagIdx = distance(x.begin(), min_element(x.begin(), x.end()));
-	float minMag = x[minMagIdx];
-	float leftMin = minMag;
-	int len = x.size();
-
-	if(len>2)
-	{
-		float tempMag = minMag;
-    	bool foundPeak = false;
-    	int ii;
-
-    	// Deal with first point a little differently since tacked it on
-        // Calculate the sign of the derivative since we tacked the first
-        //  point on it does not neccessarily alternate like the rest.
-    	vector<float> xSub0(x.begin(), x.begin()+3);//tener cuidado subvector
-    	vector<float> xDiff;//tener cuidado subvector
-    	diff(xSub0, xDiff);
-
-    	vector<int> signDx;
-    	signVector(xDiff, signDx);
-
-        if (signDx[0] <= 0) // The first point is larger or equal to the second
+	ind.insert(ind.end(), len0 - 1);
+
+	// Peak selection is shared with findPeaksInto
+	PeakWorkspace workspace;
+
+	reservePeakWorkspace(&workspace, x.size());
+	copy(x.begin(), x.end(), workspace._x.begin());
+	copy(ind.begin(), ind.end(), workspace._ind.begin());
+
+	const int found = pickPeaks(&workspace, x.size(), sel);
+
+	peakInds.insert(peakInds.end(), workspace._peakInds.begin(), workspace._peakInds.begin() + found);
+}
+
+// Derivative signs are tested per block, small enough to stay in L1
+#define PEAK_BLOCK 256
+
+void reservePeakWorkspace(PeakWorkspace* workspace, int length)
+{
+    if ((int)workspace->_x.size() < length)
+    {
+        workspace->_x.resize(length);
+        workspace->_ind.resize(length);
+        workspace->_peakInds.resize(length);
+        workspace->_peakMags.resize(length);
+    }
+}
+
+// One bit per point p[1..count], set where the derivative changes sign, as
+// findPeaks tests it: flat steps count as -EPS, the product of both sides < 0.
+// Also folds p[1..count] into the range.
+static void markTurns(const float* p, int count, unsigned char* masks, float* mn, float* mx)
+{
+    const float flat = (float)-EPS;
+
+    int i = 0;
+
+#ifdef PEAKS_X86
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 flats = _mm_set1_ps(flat);
+
+    // Lane wise the same min/max as the scalar ternaries below
+    __m128 lo = _mm_set1_ps(*mn);
+    __m128 hi = _mm_set1_ps(*mx);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 a = _mm_loadu_ps(p + i);
+        const __m128 b = _mm_loadu_ps(p + i + 1);
+        const __m128 c = _mm_loadu_ps(p + i + 2);
+
+        __m128 d0 = _mm_sub_ps(b, a);
+        __m128 d1 = _mm_sub_ps(c, b);
+
+        __m128 z = _mm_cmpeq_ps(d0, zero);
+        d0 = _mm_or_ps(_mm_andnot_ps(z, d0), _mm_and_ps(z, flats));
+        z = _mm_cmpeq_ps(d1, zero);
+        d1 = _mm_or_ps(_mm_andnot_ps(z, d1), _mm_and_ps(z, flats));
+
+        masks[i >> 2] = (unsigned char)_mm_movemask_ps(_mm_cmplt_ps(_mm_mul_ps(d0, d1), zero));
+
+        lo = _mm_min_ps(b, lo);
+        hi = _mm_max_ps(b, hi);
+    }
+
+    float lanes[4];
+
+    _mm_storeu_ps(lanes, lo);
+    *mn = min(min(lanes[0], lanes[1]), min(lanes[2], lanes[3]));
+    _mm_storeu_ps(lanes, hi);
+    *mx = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+#endif
+
+    for (; i < count; i += 4)
+    {
+        unsigned char mask = 0;
+
+        for (int k = i; k < i + 4 && k < count; ++k)
         {
-            if (signDx[0] == signDx[1]) // Want alternating signs
-            {
-                x.erase(x.begin()+1);
-                ind.erase(ind.begin()+1);
-                len = len-1;
-            }
+            float d0 = p[k + 1] - p[k];
+            float d1 = p[k + 2] - p[k + 1];
+
+            d0 = d0 == 0.0f ? flat : d0;
+            d1 = d1 == 0.0f ? flat : d1;
+
+            mask |= (d0 * d1 < 0.0f) << (k - i);
+
+            *mn = p[k + 1] < *mn ? p[k + 1] : *mn;
+            *mx = p[k + 1] > *mx ? p[k + 1] : *mx;
         }
-        else // First point is smaller than the second
+
+        masks[i >> 2] = mask;
+    }
+}
+
+int findPeaksInto(const float* x0, int len0, PeakWorkspace* workspace)
+{
+    if (len0 < 3)
+    {
+        return 0;
+    }
+
+    reservePeakWorkspace(workspace, len0);
+
+    float* x = &workspace->_x.front();
+    int* ind = &workspace->_ind.front();
+
+    float mn = x0[0];
+    float mx = x0[0];
+    int len = 1;
+
+    x[0] = x0[0];
+    ind[0] = 0;
+
+    unsigned char masks[PEAK_BLOCK / 4];
+
+    // Single pass, each block is marked then compacted while it is still in L1
+    for (int base = 0; base < len0 - 2; base += PEAK_BLOCK)
+    {
+        const int count = min(PEAK_BLOCK, len0 - 2 - base);
+
+        markTurns(x0 + base, count, masks, &mn, &mx);
+
+        for (int m = 0; m < (count + 3) / 4; ++m)
         {
-            if (signDx[0] == signDx[1]) // Want alternating signs
+            for (unsigned int bits = masks[m]; bits; bits &= bits - 1)
             {
-            	x.erase(x.begin());
-            	ind.erase(ind.begin());
-                len = len-1;
-            }
-        }
+                const int at = base + 4 * m + __builtin_ctz(bits) + 1;
 
-    	if ( x[0] >= x[1] )
-        	ii = 0;
-    	else
-        	ii = 1;
-
-    	float maxPeaks = ceil((float)len/2.0);
-    	vector<int> peakLoc(maxPeaks,0);
-    	vector<float> peakMag(maxPeaks,0.0);
-    	int cInd = 1;
-    	int tempLoc;
-    
-    	while(ii < len)
-    	{
-        	ii = ii+1;//This is a peak
-        	//Reset peak finding if we had a peak and the next peak is bigger
-        	//than the last or the left min was small enough to reset.
-        	if(foundPeak)
-        	{
-            	tempMag = minMag;
-            	foundPeak = false;
+                x[len] = x0[at];
+                ind[len] = at;
+                ++len;
             }
-        
-        	//Found new peak that was lager than temp mag and selectivity larger
-        	//than the minimum to its left.
-        
-        	if( x[ii-1] > tempMag && x[ii-1] > leftMin + sel )
-        	{
-            	tempLoc = ii-1;
-            	tempMag = x[ii-1];
-        	}
-
-        	//Make sure we don't iterate past the length of our vector
-        	if(ii == len)
-            	break; //We assign the last point differently out of the loop
-
-        	ii = ii+1; // Move onto the valley
-        	
-        	//Come down at least sel from peak
-        	if(!foundPeak && tempMag > sel + x[ii-1])
-            {            	
-	            foundPeak = true; //We have found a peak
-	            leftMin = x[ii-1];
-	            peakLoc[cInd-1] = tempLoc; // Add peak to index
-	            peakMag[cInd-1] = tempMag;
-	            cInd = cInd+1;
-	        }
-        	else if(x[ii-1] < leftMin) // New left minima
-            	leftMin = x[ii-1];
-            
         }
+    }
 
-        // Check end point
-        if ( x[x.size()-1] > tempMag && x[x.size()-1] > leftMin + sel )
+    mn = x0[len0 - 1] < mn ? x0[len0 - 1] : mn;
+    mx = x0[len0 - 1] > mx ? x0[len0 - 1] : mx;
+
+    x[len] = x0[len0 - 1];
+    ind[len] = len0 - 1;
+    ++len;
+
+    return pickPeaks(workspace, len, (float)((mx - mn) / 4.0));
+}
+
+static int signOf(float v)
+{
+    return v > 0 ? 1 : (v < 0 ? -1 : 0);
+}
+
+int pickPeaks(PeakWorkspace* workspace, int len, float sel)
+{
+    if (len <= 2)
+    {
+        return 0;
+    }
+
+    float* x = &workspace->_x.front();
+    int* ind = &workspace->_ind.front();
+    int* peakInds = &workspace->_peakInds.front();
+    float* peakMags = &workspace->_peakMags.front();
+
+    float minMag = x[0];
+
+    for (int i = 1; i < len; ++i)
+    {
+        minMag = x[i] < minMag ? x[i] : minMag;
+    }
+
+    // Signs must alternate from the first point on, findPeaks erases the first
+    // point when it rises, the second one otherwise
+    const int sign0 = signOf(x[1] - x[0]);
+
+    if (sign0 == signOf(x[2] - x[1]))
+    {
+        if (sign0 <= 0)
         {
-            peakLoc[cInd-1] = len-1;
-            peakMag[cInd-1] = x[x.size()-1];
-            cInd = cInd + 1;
+            x[1] = x[0];
+            ind[1] = ind[0];
         }
-        else if( !foundPeak && tempMag > minMag )// Check if we still need to add the last point
+
+        ++x;
+        ++ind;
+        --len;
+    }
+
+    float leftMin = minMag;
+    float tempMag = minMag;
+    bool foundPeak = false;
+    int tempLoc = 0;
+    int peaks = 0;
+    int ii = x[0] >= x[1] ? 0 : 1;
+
+    while (ii < len)
+    {
+        // Peak
+        if (foundPeak)
         {
-            peakLoc[cInd-1] = tempLoc;
-            peakMag[cInd-1] = tempMag;
-            cInd = cInd + 1;
+            tempMag = minMag;
+            foundPeak = false;
         }
 
-    	//Create output
-    	if( cInd > 0 )
-    	{        	
-        	vector<int> peakLocTmp(peakLoc.begin(), peakLoc.begin()+cInd-1);
-			selectElements(ind, peakLocTmp, peakInds);
-        	//peakMags = vector<float>(peakLoc.begin(), peakLoc.begin()+cInd-1);
+        if (x[ii] > tempMag && x[ii] > leftMin + sel)
+        {
+            tempLoc = ii;
+            tempMag = x[ii];
         }
-    	
-
 
-	}
+        if (++ii == len)
+        {
+            break;
+        }
 
+        // Valley
+        if (!foundPeak && tempMag > sel + x[ii])
+        {
+            foundPeak = true;
+            leftMin = x[ii];
+            peakInds[peaks] = ind[tempLoc];
+            peakMags[peaks] = tempMag;
+            ++peaks;
+        }
+        else if (x[ii] < leftMin)
+        {
+            leftMin = x[ii];
+        }
 
+        ++ii;
+    }
+
+    if (x[len - 1] > tempMag && x[len - 1] > leftMin + sel)
+    {
+        peakInds[peaks] = ind[len - 1];
+        peakMags[peaks] = x[len - 1];
+        ++peaks;
+    }
+    else if (!foundPeak && tempMag > minMag)
+    {
+        peakInds[peaks] = ind[tempLoc];
+        peakMags[peaks] = tempMag;
+        ++peaks;
+    }
+
+    return peaks;
 }
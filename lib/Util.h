@@ -13,4 +13,27 @@ using namespace std;
 
 void findPeaks(const vector<float>& x0, vector<int>& peakInds);
 
+// Reused between calls, findPeaksInto only allocates when an input is longer than any before
+struct PeakWorkspace
+{
+    vector<float>   _x;         // First point, extrema, last point
+    vector<int>     _ind;       // Their positions in the input
+    vector<int>     _peakInds;
+    vector<float>   _peakMags;
+};
+
+void reservePeakWorkspace(PeakWorkspace* workspace, int length);
+
+/**
+ * Same peaks as findPeaks, in one pass over x0 and without allocating.
+ * Fills _peakInds and _peakMags, returns the number of peaks.
+ */
+int findPeaksInto(const float* x0, int len0, PeakWorkspace* workspace);
+
+/**
+ * The second half of findPeaksInto, over the first len entries of _x and
+ * _ind that the caller filled, sel a quarter of the input range.
+ */
+int pickPeaks(PeakWorkspace* workspace, int len, float sel);
+
 #endif
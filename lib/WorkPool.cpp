@@ -0,0 +1,157 @@
+// WorkPool.cpp
+#include "WorkPool.h"
+#include <new>
+
+static void workerLoop(WorkPool* pool, int worker);
+
+static void* takeWorkPoolTask(WorkPool* pool, int worker);
+
+int initWorkPool(WorkPool* pool, int workers, fpWorkTask run)
+{
+    if (!pool || !run)
+    {
+        return -1;
+    }
+
+    if (workers <= 0)
+    {
+        workers = (int)std::thread::hardware_concurrency();
+    }
+
+    if (workers <= 0)
+    {
+        workers = 1;
+    }
+
+    pool->_queues = new(std::nothrow) WorkQueue[workers];
+    pool->_threads = new(std::nothrow) std::thread[workers];
+
+    if (!pool->_queues || !pool->_threads)
+    {
+        delete [] pool->_queues;
+        delete [] pool->_threads;
+        return -1;
+    }
+
+    pool->_workers = workers;
+    pool->_run = run;
+    pool->_pending.store(0);
+    pool->_nextQueue.store(0);
+    pool->_quit = false;
+
+    for (int i = 0; i < workers; ++i)
+    {
+        pool->_threads[i] = std::thread(workerLoop, pool, i);
+    }
+
+    return 0;
+}
+
+void deinitWorkPool(WorkPool* pool)
+{
+    if (!pool || !pool->_threads)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool->_sleepMutex);
+        pool->_quit = true;
+    }
+
+    pool->_wake.notify_all();
+
+    for (int i = 0; i < pool->_workers; ++i)
+    {
+        if (pool->_threads[i].joinable())
+        {
+            pool->_threads[i].join();
+        }
+    }
+
+    delete [] pool->_threads;
+    delete [] pool->_queues;
+
+    pool->_threads = nullptr;
+    pool->_queues = nullptr;
+    pool->_workers = 0;
+}
+
+void submitWorkPool(WorkPool* pool, void* task, int worker)
+{
+    // Outside submissions are spread, a worker keeps its own tasks local
+    int queue = worker >= 0 ?
+                    worker :
+                    (int)(pool->_nextQueue.fetch_add(1, std::memory_order_relaxed) % pool->_workers);
+
+    {
+        std::lock_guard<std::mutex> lock(pool->_queues[queue]._mutex);
+        pool->_queues[queue]._tasks.push_back(task);
+    }
+
+    pool->_pending.fetch_add(1, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(pool->_sleepMutex);
+    }
+
+    pool->_wake.notify_one();
+}
+
+static void* takeWorkPoolTask(WorkPool* pool, int worker)
+{
+    {
+        WorkQueue& own = pool->_queues[worker];
+
+        std::lock_guard<std::mutex> lock(own._mutex);
+
+        if (!own._tasks.empty())
+        {
+            void* task = own._tasks.front();
+            own._tasks.pop_front();
+            return task;
+        }
+    }
+
+    for (int i = 1; i < pool->_workers; ++i)
+    {
+        WorkQueue& victim = pool->_queues[(worker + i) % pool->_workers];
+
+        std::lock_guard<std::mutex> lock(victim._mutex);
+
+        if (!victim._tasks.empty())
+        {
+            void* task = victim._tasks.back();
+            victim._tasks.pop_back();
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+static void workerLoop(WorkPool* pool, int worker)
+{
+    for (;;)
+    {
+        void* task = takeWorkPoolTask(pool, worker);
+
+        if (task)
+        {
+            pool->_pending.fetch_sub(1, std::memory_order_acq_rel);
+
+            pool->_run(task, worker);
+
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(pool->_sleepMutex);
+
+        pool->_wake.wait(lock, [pool] { return pool->_quit || pool->_pending.load(std::memory_order_acquire) > 0; });
+
+        if (pool->_quit)
+        {
+            break;
+        }
+    }
+}
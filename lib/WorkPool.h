@@ -0,0 +1,46 @@
+// WorkPool.h
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+typedef void (*fpWorkTask)(void* task, int worker);
+
+struct WorkQueue
+{
+    std::mutex              _mutex;
+    std::deque<void*>       _tasks;
+};
+
+/**
+ * Fixed set of workers with one task queue each. Workers take from the
+ * front of their own queue and steal from the back of the others.
+ * Tasks are opaque, the pool never owns them.
+ */
+struct WorkPool
+{
+    std::thread*            _threads;
+    WorkQueue*              _queues;
+    int                     _workers;
+    fpWorkTask              _run;
+    std::atomic<int>        _pending;
+    std::atomic<unsigned>   _nextQueue;
+    std::mutex              _sleepMutex;
+    std::condition_variable _wake;
+    bool                    _quit;
+};
+
+// workers <= 0 uses one per hardware thread
+int initWorkPool(WorkPool* pool, int workers, fpWorkTask run);
+
+// Joins the workers, tasks still queued are dropped
+void deinitWorkPool(WorkPool* pool);
+
+// worker is the submitting worker index, -1 from outside the pool
+void submitWorkPool(WorkPool* pool, void* task, int worker);
+
+#endif
@@ -1,78 +1,62 @@
 #include "howl.h"
-#include "Util.h"
+#include "HowlContext.h"
+#include "DebugRender.h"
+#include "SampleQueue.h"
 #include <new>
 #include <utility>
 #include <cstdlib>
 #include <stdio.h>
-#include <deque>
+#include <cstring>
 #include <cstdint>
 #include <unistd.h>
 
-#include <chrono>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
-#define SPECTROGRAM_WIDTH 250//500
-#define SPECTROGRAM_HEIGHT 128//256
-#define OVERLAP_PERCENTAGE 50
-#define SILENCE_THRESHOLD 10.0
-#define MAX_SPECTROGRAMS 1
+#define ANALYSIS_DRAIN_SAMPLES 4096
 
 // #include <nonstd/ring_span.hpp>
-#include <spectrogram.h>
-#include <zncc.h>
+#ifdef GPU_SUPPORT
 #include <arrayfire.h>
-#include <cstdlib>
-#include <float.h>
+#endif
 
 using namespace std;
 
-using AudioRingBuffer = std::deque<double>;
-using SpectrogramRenders = std::deque<RENDER*>;
-
-struct HowlLibContext
+// Asynchronous mode: feeds only enqueue, this thread runs the pipeline
+struct AnalysisThread
 {
-    double*                 _sourceBuffer;
-    double*                 _captureBuffer;
-    AudioRingBuffer*        _sourceRingBuffer;
-    AudioRingBuffer*        _captureRingBuffer;
-    int                     _sampleRate;
-    int                     _bufferMs;
-    int                     _bufferSize;
-    float                   _sourceSnapshotTimeoutMs;
-    float                   _captureSnapshotTimeoutMs;
-    fpPreHowlDetected       _preHowlCb;
-    float                   _sourceSilenceMs;
-    float                   _captureSilenceMs;
-    double                  _sourceTriggerRender;
-    double                  _captureTriggerRender;
-    SpectrogramRenders*     _sourceRender;
-    SpectrogramRenders*     _captureRender;
+    std::thread             _thread;
+    std::mutex              _mutex;
+    std::condition_variable _cond;
+    bool                    _pending;
+    bool                    _quit;
+    SampleQueue             _sourceQueue;
+    SampleQueue             _captureQueue;
+    float*                  _drainBuffer;
 };
 
 void copySamples(
     const float*,
     const int,
-    const int,
-    AudioRingBuffer&);
+    AudioRing&);
 
-void setRenderTimestamp(RENDER* render);
+static int snapshotStream(HowlLibContext* ctx, HowlStream* stream, MatchWorkspace* workspace);
 
-RENDER* createNewRender();
+static int feedStream(HowlLibContext* ctx, HowlStream* stream, float* samples, int samplesSize);
 
-void destroyRender(RENDER* render);
+static int enqueueAudio(AnalysisThread* analysis, SampleQueue* queue, const float* samples, int samplesSize);
 
-void addRender(RENDER* render, SpectrogramRenders* spectrograms);
+static void analysisLoop(HowlLibContext* ctx);
 
-void checkAllRenders(HowlLibContext* ctx);
+static void stopAnalysisThread(HowlLibContext* ctx);
 
-static const char* getNextSourceRenderPath();
-
-static const char* getNextCaptureRenderPath();
-
-af::array normalize(af::array a);
+void debugRender(HowlLibContext* ctx, AudioRing* ring, const char* name, int index);
 
 HowlLibContext* createHowlLibContext()
 {
-    auto howlLibCtx = new(nothrow) HowlLibContext;
+    auto howlLibCtx = new(nothrow) HowlLibContext();
     return howlLibCtx;
 }
 
@@ -85,46 +69,41 @@ void destroyHowlLibContext(
         return;
     }
 
-    ctx->_preHowlCb = nullptr;
+    // Pipeline must be idle before anything is released
+    stopAnalysisThread(ctx);
 
-    if (ctx->_sourceRingBuffer)
-    {
-        delete ctx->_sourceRingBuffer;
-    }
+    // Engine pairs borrow the engine's plan
+    const bool bOwnsPlan = !ctx->_pair;
 
-    if (ctx->_captureRingBuffer)
+    if (ctx->_pair)
     {
-        delete ctx->_captureRingBuffer;
+        detachEnginePair(ctx);
     }
 
-    if (ctx->_sourceBuffer)
-    {
-        delete [] ctx->_sourceBuffer;
-    }
+    ctx->_preHowlCb = nullptr;
+    ctx->_matchCb = nullptr;
+    ctx->_earlyCb = nullptr;
 
-    if (ctx->_captureBuffer)
-    {
-        delete [] ctx->_captureBuffer;
-    }
+    deinitHowlStream(&ctx->_source);
+    deinitHowlStream(&ctx->_capture);
 
-    if (ctx->_sourceRender)
-    {
-        for (auto r = ctx->_sourceRender->begin(); r != ctx->_sourceRender->end(); r++)
-        {
-            destroyRender(*r);
-        }
+    destroyLoopDelay(ctx->_loopDelay);
+    destroyLandmarkMatcher(ctx->_landmarks);
+    destroyEarlyHowl(ctx->_earlyHowl);
 
-        delete ctx->_sourceRender;
+    // Streams gave their renders back above
+    if (ctx->_renderPool)
+    {
+        deinitRenderPool(ctx->_renderPool);
+        delete ctx->_renderPool;
     }
 
-    if (ctx->_captureRender)
-    {
-        for (auto r = ctx->_captureRender->begin(); r != ctx->_captureRender->end(); r++)
-        {
-            destroyRender(*r);
-        }
+    delete ctx->_rendersMutex;
 
-        delete ctx->_captureRender;
+    if (bOwnsPlan && ctx->_fftPlan)
+    {
+        deinitFftPlan(ctx->_fftPlan);
+        delete ctx->_fftPlan;
     }
 
     delete ctx;
@@ -137,413 +116,847 @@ int initHowlLibContext(
     fpPreHowlDetected howlPreDetectCallback
 )
 {
-    if (!ctx)
+    return initHowlLibContextBackend(
+        ctx,
+        sampleRate,
+        bufferMs,
+        howlPreDetectCallback,
+        HOWL_BACKEND_DEFAULT);
+}
+
+int initHowlLibContextBackend(
+    HowlLibContext* ctx, // HowlLib
+    int sampleRate, // SampleRate
+    int bufferMs, // Buffer ms
+    fpPreHowlDetected howlPreDetectCallback,
+    int backend // HOWL_BACKEND_*
+)
+{
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = backend;
+
+    return initHowlLibContextEx(
+        ctx,
+        sampleRate,
+        bufferMs,
+        howlPreDetectCallback,
+        &config);
+}
+
+int initHowlLibContextEx(
+    HowlLibContext* ctx, // HowlLib
+    int sampleRate, // SampleRate
+    int bufferMs, // Buffer ms
+    fpPreHowlDetected howlPreDetectCallback,
+    const HowlLibConfig* config
+)
+{
+    if (!ctx || !config || sampleRate <= 0 || bufferMs <= 0)
     {
         return -1;
     }
 
-    ctx->_bufferSize = bufferMs * sampleRate / 1000;
+    // Everything destroyHowlLibContext releases must be valid on any early return
+    memset(&ctx->_source, 0, sizeof(HowlStream));
+    memset(&ctx->_capture, 0, sizeof(HowlStream));
+    ctx->_fftPlan = nullptr;
+    ctx->_analysis = nullptr;
+    ctx->_pair = nullptr;
+    ctx->_rendersMutex = nullptr;
+    ctx->_renderPool = nullptr;
+    ctx->_loopDelay = nullptr;
+    ctx->_landmarks = nullptr;
+    ctx->_earlyHowl = nullptr;
+    ctx->_alignment.store(0);
+
+    resetHowlStats(&ctx->_stats);
 
-    ctx->_sourceBuffer = new(std::nothrow) double[ctx->_bufferSize];
-    ctx->_captureBuffer = new(std::nothrow) double[ctx->_bufferSize];
+    ctx->_sampleRate = sampleRate;
+    ctx->_bufferMs = bufferMs;
+    ctx->_bufferSize = bufferMs * sampleRate / 1000;
 
-    if (!ctx->_sourceBuffer || !ctx->_captureBuffer)
+    if (0 != resolveHowlLibConfig(&ctx->_config, config, ctx->_bufferSize))
     {
         return -1;
     }
 
-    ctx->_sourceRender = new(std::nothrow) SpectrogramRenders; //new(std::nothrow) RENDER;
+    ctx->_snapshotHop = getSnapshotHop(ctx->_bufferSize, ctx->_config._overlapPercentage);
+
+    resolveHowlLagRange(ctx);
+
+    ctx->_preHowlCb = howlPreDetectCallback;
+    ctx->_matchCb = nullptr;
+    ctx->_matchCbData = nullptr;
+    ctx->_earlyCb = nullptr;
+    ctx->_earlyCbData = nullptr;
 
-    if (!ctx->_sourceRender)
+    ctx->_rendersMutex = new(std::nothrow) std::mutex;
+    ctx->_renderPool = new(std::nothrow) RenderPool();
+    ctx->_fftPlan = new(std::nothrow) FftPlan;
+
+    if (!ctx->_rendersMutex || !ctx->_renderPool || !ctx->_fftPlan)
     {
         return -1;
     }
 
-    ctx->_captureRender = new(std::nothrow) SpectrogramRenders; //new(std::nothrow) RENDER;
+    // History of both streams, one render in flight each
+    if (0 != initRenderPool(ctx->_renderPool, ctx->_config._spectrogramWidth, ctx->_config._spectrogramHeight, SPECTROGRAM_FORMAT, 2 * (ctx->_config._maxSpectrograms + 1)))
+    {
+        return -1;
+    }
 
-    if (!ctx->_captureRender)
+    if (ctx->_config._delayTracking && !(ctx->_loopDelay = createLoopDelay(ctx)))
     {
         return -1;
     }
 
-    ctx->_sourceRingBuffer = new(std::nothrow) deque<double>();
-    ctx->_captureRingBuffer = new(std::nothrow) deque<double>();
+    if (ctx->_config._backend == HOWL_BACKEND_LANDMARK && !(ctx->_landmarks = createLandmarkMatcher(ctx)))
+    {
+        return -1;
+    }
 
-    if (!ctx->_sourceRingBuffer || !ctx->_captureRingBuffer)
+    // One column per spectrogram pixel, no resampling on snapshot
+    if (0 != initFftPlan(ctx->_fftPlan, getFftSizeForHop(ctx->_bufferSize / ctx->_config._spectrogramWidth)))
     {
+        delete ctx->_fftPlan;
+        ctx->_fftPlan = nullptr;
         return -1;
     }
 
-    ctx->_sampleRate = sampleRate;
-    ctx->_bufferMs = bufferMs;
-    ctx->_preHowlCb = howlPreDetectCallback;
-    ctx->_sourceTriggerRender = pow(10, (SILENCE_THRESHOLD / 20.0) );
-    ctx->_captureTriggerRender = pow(10, (SILENCE_THRESHOLD / 20.0) );
+    if (0 != initHowlStream(ctx, &ctx->_source, "source", true) ||
+        0 != initHowlStream(ctx, &ctx->_capture, "capture", true))
+    {
+        return -1;
+    }
 
-    af::setDevice(0);
-    af::info();
+    if (ctx->_config._howlDetection != HOWL_DETECTION_OFF && !(ctx->_earlyHowl = createEarlyHowl(ctx)))
+    {
+        return -1;
+    }
+
+#ifdef GPU_SUPPORT
+    if (ctx->_config._backend == HOWL_BACKEND_ARRAYFIRE)
+    {
+        af::setDevice(0);
+        af::info();
+    }
+#endif
 
     return 0;
 }
 
-int feedSourceAudio(
-    HowlLibContext* ctx,
-    float* samples,
-    int samplesSize
+void getHowlLibDefaultConfig(
+    HowlLibConfig* config
 )
 {
-    copySamples(samples,
-                samplesSize,
-                ctx->_bufferSize,
-                *ctx->_sourceRingBuffer);
-
-    if (ctx->_sourceRingBuffer->size() ==
-        ctx->_bufferSize)
+    if (!config)
     {
+        return;
+    }
 
-        float msAdded = (float)samplesSize / ((float)ctx->_sampleRate / 1000);
+    config->_spectrogramWidth = SPECTROGRAM_WIDTH;
+    config->_spectrogramHeight = SPECTROGRAM_HEIGHT;
+    config->_overlapPercentage = OVERLAP_PERCENTAGE;
+    config->_silenceThresholdDb = SILENCE_THRESHOLD;
+    config->_maxSpectrograms = MAX_SPECTROGRAMS;
+    config->_matchThreshold = MATCH_THRESHOLD;
+    config->_rangeDb = SPECTROGRAM_RANGE_DB;
+    config->_backend = HOWL_BACKEND_DEFAULT;
+    config->_pyramidLevels = PYRAMID_LEVELS;
+    config->_pyramidMargin = PYRAMID_MARGIN;
+    config->_minLagMs = MIN_LAG_MS;
+    config->_maxLagMs = MAX_LAG_MS;
+    config->_delayTracking = DELAY_TRACKING;
+    config->_delayCoherence = DELAY_COHERENCE;
+    config->_howlDetection = HOWL_DETECTION;
+    config->_howlPaprDb = HOWL_PAPR_DB;
+    config->_howlPhprDb = HOWL_PHPR_DB;
+    config->_howlPersistenceMs = HOWL_PERSISTENCE_MS;
+}
 
-        ctx->_sourceSnapshotTimeoutMs += msAdded;
+int resolveHowlLibConfig(HowlLibConfig* resolved, const HowlLibConfig* config, int bufferSize)
+{
+    const int width = config->_spectrogramWidth;
+    const int height = config->_spectrogramHeight;
 
-        //fprintf(stdout, "%f added %f total\n", msAdded, ctx->_sourceSnapshotTimeoutMs);
+    // Every column needs at least one sample of hop
+    if (width < 2 || bufferSize < width)
+    {
+        return -1;
+    }
 
-        if (ctx->_sourceSnapshotTimeoutMs >  ((OVERLAP_PERCENTAGE / 100) * ctx->_bufferMs) )
-        {
-            // fprintf(stdout, "%f milliseconds have passed\n", ctx->_sourceSnapshotTimeoutMs);
+    // Bands are built from the non DC bins of the column transform
+    const int bins = getFftSizeForHop(bufferSize / width) / 2;
 
-            for (int i = 0; i < ctx->_bufferSize; ++i) {
-                ctx->_sourceBuffer[i] = ctx->_sourceRingBuffer->at(i);
-            }
+    if (height < 1 || height > bins)
+    {
+        return -1;
+    }
 
-            RENDER* sourceRender = createNewRender();
+    if (config->_overlapPercentage < 0 || config->_overlapPercentage >= 100 ||
+        config->_maxSpectrograms < 1 ||
+        !(config->_matchThreshold > 0.0f && config->_matchThreshold <= 1.0f) ||
+        !(config->_rangeDb > 0.0f))
+    {
+        return -1;
+    }
 
-            setRenderTimestamp(sourceRender);
+    // The coarse image keeps at least 2x2 pixels
+    if (config->_pyramidLevels < 0 || config->_pyramidLevels > 8 ||
+        (width >> config->_pyramidLevels) < 2 || (height >> config->_pyramidLevels) < 2 ||
+        !(config->_pyramidMargin >= 0.0f))
+    {
+        return -1;
+    }
 
-            sourceRender->pngfilepath = getNextSourceRenderPath();
+    // Landmarks are picked on the full resolution image only
+    if (config->_backend == HOWL_BACKEND_LANDMARK && config->_pyramidLevels > 0)
+    {
+        return -1;
+    }
 
-            unsigned char* bitmapData = nullptr;
-            // // get spectrogram
+    if (config->_minLagMs > config->_maxLagMs ||
+        (config->_delayTracking != 0 && config->_delayTracking != 1) ||
+        !(config->_delayCoherence > 0.0f && config->_delayCoherence <= 1.0f))
+    {
+        return -1;
+    }
 
-            int ret = render_spectrogram_bitmap(
-                ctx->_sourceBuffer,
-                ctx->_bufferSize,
-                ctx->_sampleRate,
-                &bitmapData,
-                SPECTROGRAM_WIDTH,
-                SPECTROGRAM_HEIGHT,
-                sourceRender,
-                ctx->_sourceTriggerRender
-            );
+    if (config->_howlDetection < HOWL_DETECTION_OFF || config->_howlDetection > HOWL_DETECTION_CONFIRM ||
+        !(config->_howlPaprDb >= 0.0f) || !(config->_howlPhprDb >= 0.0f) ||
+        config->_howlPersistenceMs <= 0)
+    {
+        return -1;
+    }
 
-            if (ret == 0)
-            {
-                addRender(sourceRender, ctx->_sourceRender);
+    *resolved = *config;
 
-                checkAllRenders(ctx);
-            }
-            else
-            {
-                destroyRender(sourceRender);
-            }
+    resolved->_backend = resolveHowlBackend(config->_backend);
 
-            ctx->_sourceSnapshotTimeoutMs = 0;
-        }
+    return resolved->_backend < 0 ? -1 : 0;
+}
+
+int resolveHowlBackend(int backend)
+{
+    if (backend == HOWL_BACKEND_DEFAULT)
+    {
+#ifdef GPU_SUPPORT
+        backend = HOWL_BACKEND_ARRAYFIRE;
+#else
+        backend = HOWL_BACKEND_CPU;
+#endif
     }
 
-    // if (ctx->_sourceSnapshotTimeoutMs > 1500)
-    // {
-    //     printf("SOURCE NOT ADDED!\n");
-    // }
+#ifndef GPU_SUPPORT
+    if (backend == HOWL_BACKEND_ARRAYFIRE)
+    {
+        return -1;
+    }
+#endif
 
-    return 0;
+    if (backend != HOWL_BACKEND_ARRAYFIRE &&
+        backend != HOWL_BACKEND_CPU &&
+        backend != HOWL_BACKEND_FFT &&
+        backend != HOWL_BACKEND_LANDMARK)
+    {
+        return -1;
+    }
+
+    return backend;
 }
 
-int feedCaptureAudio(
-    HowlLibContext* ctx,
-    float* samples,
-    int samplesSize
-)
+int getSnapshotHop(int bufferSize, int overlapPercentage)
 {
+    int hop = (int)((long long)bufferSize * (100 - overlapPercentage) / 100);
 
-    copySamples(samples,
-                samplesSize,
-                ctx->_bufferSize,
-                *ctx->_captureRingBuffer);
+    return hop > 0 ? hop : 1;
+}
 
-    if (ctx->_captureRingBuffer->size() ==
-        ctx->_bufferSize)
+void resolveHowlLagRange(HowlLibContext* ctx)
+{
+    if (ctx->_config._minLagMs == 0 && ctx->_config._maxLagMs == 0)
     {
+        // Windows that overlap at all
+        ctx->_minLag = -(ctx->_bufferSize - 1);
+        ctx->_maxLag = ctx->_bufferSize - 1;
+        return;
+    }
 
-        float msAdded = (float)samplesSize / ((float)ctx->_sampleRate / 1000);
-
-        ctx->_captureSnapshotTimeoutMs += msAdded;
+    ctx->_minLag = (long long)ctx->_config._minLagMs * ctx->_sampleRate / 1000;
+    ctx->_maxLag = (long long)ctx->_config._maxLagMs * ctx->_sampleRate / 1000;
+}
 
-        //fprintf(stdout, "%f added %f total\n", msAdded, ctx->_sourceSnapshotTimeoutMs);
+int initHowlStream(HowlLibContext* ctx, HowlStream* stream, const char* name, bool bWorkspace)
+{
+    stream->_name = name;
+    // First snapshot once the ring is full, then one per hop
+    stream->_nextSnapshot = ctx->_bufferSize;
+    stream->_triggerRender = pow(10, (ctx->_config._silenceThresholdDb / 20.0) );
+    stream->_renderCount = 0;
+    stream->_stftNs = 0;
 
-        if (ctx->_captureSnapshotTimeoutMs >  ((OVERLAP_PERCENTAGE / 100) * ctx->_bufferMs) )
-        {
-            // fprintf(stdout, "%f milliseconds have passed\n", ctx->_sourceSnapshotTimeoutMs);
+    stream->_renders = new(std::nothrow) RenderHistory();
+    stream->_arrivals = createStreamArrivals();
 
-            for (int i = 0; i < ctx->_bufferSize; ++i) {
-                ctx->_captureBuffer[i] = ctx->_captureRingBuffer->at(i);
-            }
+    if (!stream->_renders || !stream->_arrivals)
+    {
+        return -1;
+    }
 
-            RENDER* captureRender = createNewRender();
+    if (0 != initRenderHistory(stream->_renders, ctx->_config._maxSpectrograms))
+    {
+        return -1;
+    }
 
-            setRenderTimestamp(captureRender);
+    AudioRing* ring = new(std::nothrow) AudioRing;
 
-            captureRender->pngfilepath = getNextCaptureRenderPath();
+    if (!ring || 0 != initAudioRing(ring, ctx->_bufferSize))
+    {
+        delete ring;
+        return -1;
+    }
 
-            unsigned char* bitmapData = nullptr;
-            // get spectrogram
+    stream->_ringBuffer = ring;
 
-            int ret = render_spectrogram_bitmap(
-                ctx->_captureBuffer,
-                ctx->_bufferSize,
-                ctx->_sampleRate,
-                &bitmapData,
-                SPECTROGRAM_WIDTH,
-                SPECTROGRAM_HEIGHT,
-                captureRender,
-                ctx->_captureTriggerRender
-            );
+    StftStream* stft = new(std::nothrow) StftStream;
 
-            if (ret == 0)
-            {
+    if (!stft || 0 != initStftStream(stft, ctx->_fftPlan, ctx->_bufferSize, ctx->_config._spectrogramWidth, ctx->_config._spectrogramHeight))
+    {
+        delete stft;
+        return -1;
+    }
 
-                addRender(captureRender, ctx->_captureRender);
+    stream->_stft = stft;
 
-                checkAllRenders(ctx);
+    // Engine pairs match with the worker's scratch instead
+    if (!bWorkspace)
+    {
+        return 0;
+    }
 
-            }
-            else
-            {
-                destroyRender(captureRender);                
-            }
+    stream->_workspace = new(std::nothrow) MatchWorkspace;
 
-            ctx->_captureSnapshotTimeoutMs = 0;
-        }
+    if (!stream->_workspace)
+    {
+        return -1;
     }
 
-    // if (ctx->_captureSnapshotTimeoutMs > 1500)
-    // {
-    //     printf("CAPTURE NOT ADDED!\n");
-    // }
+    // Each feeding thread matches with its own scratch
+    if (0 != initMatchWorkspace(stream->_workspace, &ctx->_config))
+    {
+        deinitMatchWorkspace(stream->_workspace);
+        delete stream->_workspace;
+        stream->_workspace = nullptr;
+        return -1;
+    }
 
     return 0;
 }
 
-void copySamples(
-    const float* samples,
-    const int samplesSize,
-    const int maxBufferSize,
-    AudioRingBuffer& buffer)
+void deinitHowlStream(HowlStream* stream)
 {
+    if (stream->_ringBuffer)
+    {
+        deinitAudioRing(stream->_ringBuffer);
+        delete stream->_ringBuffer;
+    }
 
-    for (int i = 0; i < samplesSize; ++i)
+    if (stream->_stft)
     {
-        if (buffer.size() >= maxBufferSize)
-        {
-            buffer.pop_front();
-        }
+        deinitStftStream(stream->_stft);
+        delete stream->_stft;
+    }
 
-        buffer.push_back(samples[i]);
+    if (stream->_workspace)
+    {
+        deinitMatchWorkspace(stream->_workspace);
+        delete stream->_workspace;
     }
+
+    if (stream->_renders)
+    {
+        deinitRenderHistory(stream->_renders);
+
+        delete stream->_renders;
+    }
+
+    delete stream->_arrivals;
+
+    memset(stream, 0, sizeof(HowlStream));
 }
 
-void setRenderTimestamp(RENDER* render)
+int setHowlLibStreamAlignment(
+    HowlLibContext* ctx,
+    long long captureLagSamples
+)
 {
-    unsigned long milliseconds_since_epoch = 
-        std::chrono::duration_cast<std::chrono::milliseconds>
-            (std::chrono::system_clock::now().time_since_epoch()).count();
+    if (!ctx)
+    {
+        return -1;
+    }
+
+    ctx->_alignment.store(captureLagSamples, std::memory_order_relaxed);
 
-    render->time_stamp = milliseconds_since_epoch;
+    return 0;
 }
 
-RENDER* createNewRender()
+int setHowlLibEarlyCallback(
+    HowlLibContext* ctx,
+    fpHowlEarlyDetected earlyCallback,
+    void* userData
+)
 {
-    RENDER* newRender = new (std::nothrow) RENDER;
-
-    if (0 != init_spectrogram(newRender))
+    if (!ctx)
     {
-        delete newRender;
-        return NULL;
+        return -1;
     }
 
-    return newRender;
+    ctx->_earlyCb = earlyCallback;
+    ctx->_earlyCbData = userData;
+
+    return 0;
 }
 
-void destroyRender(RENDER* render)
+int setHowlLibMatchCallback(
+    HowlLibContext* ctx,
+    fpHowlMatchDetected matchCallback,
+    void* userData
+)
 {
-    deinit_spectrogram(render);
-
-    if (render->pngfilepath)
+    if (!ctx)
     {
-        delete [] render->pngfilepath;
+        return -1;
     }
 
-    delete render;
+    ctx->_matchCb = matchCallback;
+    ctx->_matchCbData = userData;
+
+    return 0;
+}
+
+int feedSourceAudio(
+    HowlLibContext* ctx,
+    float* samples,
+    int samplesSize
+)
+{
+    const long long trace = beginHowlTrace();
+
+    int result = feedStream(ctx, &ctx->_source, samples, samplesSize);
+
+    endHowlTrace("feedSourceAudio", trace);
+
+    return result;
+}
+
+int feedCaptureAudio(
+    HowlLibContext* ctx,
+    float* samples,
+    int samplesSize
+)
+{
+    const long long trace = beginHowlTrace();
+
+    int result = feedStream(ctx, &ctx->_capture, samples, samplesSize);
+
+    endHowlTrace("feedCaptureAudio", trace);
+
+    return result;
 }
 
-void addRender(RENDER* render, SpectrogramRenders* spectrograms)
+static int feedStream(
+    HowlLibContext* ctx,
+    HowlStream* stream,
+    float* samples,
+    int samplesSize
+)
 {
-    if (spectrograms->size() >= MAX_SPECTROGRAMS)
+    const bool bSource = stream == &ctx->_source;
+    const long long arrival = getHowlTimeNs();
+
+    std::atomic<long long>& fed = bSource ? ctx->_stats._sourceSamples : ctx->_stats._captureSamples;
+
+    int result = 0;
+
+    if (ctx->_pair || ctx->_analysis)
     {
-        RENDER* _render = spectrograms->front();
+        if (ctx->_pair)
+        {
+            result = feedEnginePair(ctx, bSource ? &ctx->_pair->_sourceQueue : &ctx->_pair->_captureQueue, samples, samplesSize);
+        }
+        else
+        {
+            result = enqueueAudio(ctx->_analysis, bSource ? &ctx->_analysis->_sourceQueue : &ctx->_analysis->_captureQueue, samples, samplesSize);
+        }
 
-        destroyRender(_render);
+        // Queued samples can be analysed before the stamp exists, their latency is then not recorded.
+        // Refused ones are stamped too, analysis still counts them in the stream position
+        stampStreamArrival(stream->_arrivals, samplesSize, arrival);
 
-        spectrograms->pop_front();
+        if (result != 0)
+        {
+            ctx->_stats._droppedSamples.fetch_add(samplesSize, std::memory_order_relaxed);
+        }
+        else
+        {
+            fed.fetch_add(samplesSize, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        stampStreamArrival(stream->_arrivals, samplesSize, arrival);
+        fed.fetch_add(samplesSize, std::memory_order_relaxed);
+
+        result = processStreamAudio(ctx, stream, stream->_workspace, samples, samplesSize);
     }
 
-    spectrograms->push_back(render);
+    // What the caller's thread paid, the whole analysis when synchronous
+    recordHowlStat(&ctx->_stats._feed, getHowlTimeNs() - arrival);
+
+    return result;
 }
 
-void checkAllRenders(HowlLibContext* ctx)
+int processStreamAudio(
+    HowlLibContext* ctx,
+    HowlStream* stream,
+    MatchWorkspace* workspace,
+    const float* samples,
+    int samplesSize
+)
 {
-    try
+    int result = 0;
+
+    // Chunks are split at snapshot boundaries, the window is exact whatever the feed size
+    while (samplesSize > 0)
     {
+        const long long untilSnapshot = stream->_nextSnapshot - getAudioRingPosition(stream->_ringBuffer);
+
+        const int count = untilSnapshot < samplesSize ? (int)untilSnapshot : samplesSize;
+
+        const long long start = getHowlTimeNs();
 
-        unsigned int width = 0, height = 0;
+        copySamples(samples,
+                    count,
+                    *stream->_ringBuffer);
 
-        // Check capture spectrograms against source spectrograms
-        for (int i = 0; i < ctx->_captureRender->size(); ++i)
+        const int columns = updateStftStream(stream->_stft, stream->_ringBuffer);
+
+        stream->_stftNs += getHowlTimeNs() - start;
+
+        if (ctx->_earlyHowl && stream == &ctx->_capture)
         {
+            trackEarlyHowl(ctx, stream, columns);
+        }
 
-            RENDER* captureRender = ctx->_captureRender->at(i);
+        samples += count;
+        samplesSize -= count;
 
-            for (int j = 0; j < ctx->_sourceRender->size(); ++j)
+        if (getAudioRingPosition(stream->_ringBuffer) == stream->_nextSnapshot)
+        {
+            stream->_nextSnapshot += ctx->_snapshotHop;
+
+            if (0 != snapshotStream(ctx, stream, workspace))
             {
+                ctx->_stats._errors.fetch_add(1, std::memory_order_relaxed);
+                result = -1;
+            }
+        }
+    }
 
-                RENDER* sourceRender = ctx->_sourceRender->at(j);
+    return result;
+}
 
-                long passed = captureRender->time_stamp - sourceRender->time_stamp > 0 ?
-                                captureRender->time_stamp - sourceRender->time_stamp :
-                                sourceRender->time_stamp - captureRender->time_stamp;
+void skipStreamAudio(
+    HowlLibContext* ctx,
+    HowlStream* stream,
+    long long samplesSize
+)
+{
+    if (samplesSize <= 0)
+    {
+        return;
+    }
 
-                if (passed >= ctx->_bufferMs)
-                {
-                    // Skip if spectrograms are too far apart timewise
-                    // printf("SKIP\n");
-                    continue;
-                }
+    writeAudioRingSilence(stream->_ringBuffer, samplesSize);
 
-                unsigned int stride = 0;
+    const int columns = updateStftStream(stream->_stft, stream->_ringBuffer);
 
-                unsigned char* sourceBuffer = get_spectrogram_buffer(sourceRender, &width, &height, &stride);
-                unsigned char* captureBuffer = get_spectrogram_buffer(captureRender, &width, &height, &stride);
+    if (ctx->_earlyHowl && stream == &ctx->_capture)
+    {
+        trackEarlyHowl(ctx, stream, columns);
+    }
 
-                af::array img1(width, height, u32);
-                af::array img2(width, height, u32);
-                // maybe
-                // use stride -> lock/unlock
-                // or setup cairo or replace cairo
-                img1.write(sourceBuffer, height * width * 4);
-                img2.write(captureBuffer, height * width * 4);
+    // Windows ending inside the gap are not taken, the next one stays on the snapshot grid
+    const long long position = getAudioRingPosition(stream->_ringBuffer);
 
-                af::array result =
-                    matchTemplate(img2, img1, AF_ZSSD);
+    while (stream->_nextSnapshot <= position)
+    {
+        stream->_nextSnapshot += ctx->_snapshotHop;
+    }
+}
 
-                af::array disp_norm = normalize(result);
-                // prepare for peaks...
-                // TODO modify peaks and remove this
-                af::array disp_res = 1.0 - disp_norm;
+static int snapshotStream(
+    HowlLibContext* ctx,
+    HowlStream* stream,
+    MatchWorkspace* workspace
+)
+{
+    if (!hasStftWindow(stream->_stft))
+    {
+        return 0;
+    }
 
-                std::vector<float> v(disp_res.elements());
-                disp_res.host(&v.front());
-                vector<int> idxs;
+    const long long stftNs = stream->_stftNs;
 
-                findPeaks(v, idxs);
+    stream->_stftNs = 0;
 
-                float avgPeak = 0.0;
+    // Silent windows are not worth matching
+    if (getStftPeak(stream->_stft) < stream->_triggerRender)
+    {
+        ctx->_stats._silentSnapshots.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
 
-                for (int i = 0; i < idxs.size(); ++i)
-                {
-                    avgPeak += v[idxs[i]];
-                }
+    // Confirmation only, windows the early detector found nothing in are not matched
+    if (ctx->_config._howlDetection == HOWL_DETECTION_CONFIRM && stream == &ctx->_capture && !hasEarlyHowl(ctx, stream))
+    {
+        ctx->_stats._unflaggedSnapshots.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
 
-                avgPeak /= idxs.size();
+    if (ctx->_loopDelay)
+    {
+        if (stream == &ctx->_source)
+        {
+            publishLoopDelaySource(ctx, stream);
+        }
+        else
+        {
+            trackLoopDelay(ctx, stream);
+        }
+    }
 
-                bool bMatch = true;
+    const long long start = getHowlTimeNs();
+    const long long trace = beginHowlTrace();
 
-                if (avgPeak >= 0.75)
-                {
-                    bMatch = false;
-                }
+    SpectrumRender* render = acquireRender(ctx->_renderPool);
 
-                if (bMatch)
-                {
-                    if (ctx->_preHowlCb != NULL)
-                    {
-                        (*ctx->_preHowlCb)();
-                    }
+    if (!render)
+    {
+        return -1;
+    }
 
-                    fprintf(stdout, "MATCH %f - %s %s!\n", avgPeak, sourceRender->pngfilepath, captureRender->pngfilepath);
-                }
-                else
-                {
-                    // fprintf(stdout, "NOT MATCH %f - %s %s!\n", avgPeak, sourceRender->pngfilepath, captureRender->pngfilepath);
-                }
-            }
-        }
+    render->_position = getAudioRingPosition(stream->_ringBuffer);
+    render->_index = stream->_renderCount++;
+
+    // Columns are already transformed, only band/dB mapping is left
+    fillRender(render, stream->_stft, ctx->_config._rangeDb);
+
+    if (0 != prepareRender(ctx, stream, workspace, render))
+    {
+        releaseRender(render);
+        return -1;
     }
-    catch(const std::exception& e)
+
+    endHowlTrace("render_spectrogram", trace);
+
+    recordHowlStat(&ctx->_stats._spectrogram, stftNs + getHowlTimeNs() - start);
+
+    debugRender(ctx, stream->_ringBuffer, stream->_name, render->_index);
+
+    if (ctx->_landmarks)
     {
-        fprintf(stderr, "%s\n", e.what());
+        ctx->_stats._snapshots.fetch_add(1, std::memory_order_relaxed);
+
+        checkLandmarks(ctx, stream, render);
+
+        releaseRender(render);
+
+        return 0;
     }
+
+    SpectrumRender* evicted = publishRender(ctx, stream, render, workspace->_snapshot);
+
+    if (evicted)
+    {
+        releaseRender(evicted);
+    }
+
+    ctx->_stats._snapshots.fetch_add(1, std::memory_order_relaxed);
+
+    checkAllRenders(ctx, workspace, stream, render);
+
+    return 0;
 }
 
-static const char* getNextSourceRenderPath()
+int startHowlLibAnalysisThread(
+    HowlLibContext* ctx,
+    int queueMs
+)
 {
-    static int count1 = 0;
+    if (!ctx || ctx->_analysis || ctx->_pair || queueMs <= 0)
+    {
+        return -1;
+    }
+
+    AnalysisThread* analysis = new(std::nothrow) AnalysisThread;
+
+    if (!analysis)
+    {
+        return -1;
+    }
 
-    char* path1 = new(std::nothrow) char[64];
+    const int queueSize = (int)((long long)queueMs * ctx->_sampleRate / 1000);
 
-    memset(path1, 0, sizeof(char) * 64);
+    analysis->_pending = false;
+    analysis->_quit = false;
+    analysis->_drainBuffer = new(std::nothrow) float[ANALYSIS_DRAIN_SAMPLES];
 
-    sprintf(path1, "./source_%d.png", count1);
+    if (!analysis->_drainBuffer ||
+        0 != initSampleQueue(&analysis->_sourceQueue, queueSize))
+    {
+        delete [] analysis->_drainBuffer;
+        delete analysis;
+        return -1;
+    }
 
-    count1++;
+    if (0 != initSampleQueue(&analysis->_captureQueue, queueSize))
+    {
+        deinitSampleQueue(&analysis->_sourceQueue);
+        delete [] analysis->_drainBuffer;
+        delete analysis;
+        return -1;
+    }
+
+    ctx->_analysis = analysis;
 
-    return path1;
+    analysis->_thread = std::thread(analysisLoop, ctx);
+
+    return 0;
 }
 
-static const char* getNextCaptureRenderPath()
+static void stopAnalysisThread(HowlLibContext* ctx)
 {
-    static int count = 0;
+    AnalysisThread* analysis = ctx->_analysis;
 
-    char* path = new(std::nothrow) char[64];
+    if (!analysis)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(analysis->_mutex);
+        analysis->_quit = true;
+    }
 
-    memset(path, 0,  sizeof(char) * 64);
+    analysis->_cond.notify_one();
 
-    sprintf(path, "./capture_%d.png", count);
+    if (analysis->_thread.joinable())
+    {
+        analysis->_thread.join();
+    }
+
+    ctx->_analysis = nullptr;
 
-    count++;
+    deinitSampleQueue(&analysis->_sourceQueue);
+    deinitSampleQueue(&analysis->_captureQueue);
 
-    return path;
+    delete [] analysis->_drainBuffer;
+    delete analysis;
 }
 
-// Modified for single loop from arrayfire example
-af::array normalize(af::array a) {
+static int enqueueAudio(AnalysisThread* analysis, SampleQueue* queue, const float* samples, int samplesSize)
+{
+    // Bounded, a full queue means analysis fell behind realtime
+    const bool bPushed = pushSampleQueue(queue, samples, samplesSize);
 
-    std::vector<float> hostImg(a.elements());
-    a.host(&hostImg.front());
+    // Refused samples wake analysis too, it has to take the gap
+    {
+        std::lock_guard<std::mutex> lock(analysis->_mutex);
+        analysis->_pending = true;
+    }
 
-    float mx = FLT_MIN, mn = FLT_MAX;
+    analysis->_cond.notify_one();
 
-    for (int i = 0; i < hostImg.size(); ++i)
+    return bPushed ? 0 : -1;
+}
+
+static void analysisLoop(HowlLibContext* ctx)
+{
+    AnalysisThread* analysis = ctx->_analysis;
+
+    for (;;)
     {
-        float value = hostImg[i];
-        if (value > mx)
         {
-            mx = value;
+            std::unique_lock<std::mutex> lock(analysis->_mutex);
+
+            analysis->_cond.wait(lock, [analysis] { return analysis->_pending || analysis->_quit; });
+
+            if (analysis->_quit)
+            {
+                break;
+            }
+
+            analysis->_pending = false;
         }
 
-        if (value < mn)
+        // Interleave both streams chunk by chunk so neither starves
+        bool bDrained = false;
+
+        while (!bDrained)
         {
-            mn = value;
+            int sourceSize = popSampleQueue(&analysis->_sourceQueue, analysis->_drainBuffer, ANALYSIS_DRAIN_SAMPLES);
+
+            if (sourceSize > 0)
+            {
+                processStreamAudio(ctx, &ctx->_source, ctx->_source._workspace, analysis->_drainBuffer, sourceSize);
+            }
+            else
+            {
+                skipStreamAudio(ctx, &ctx->_source, takeSampleQueueGap(&analysis->_sourceQueue));
+            }
+
+            int captureSize = popSampleQueue(&analysis->_captureQueue, analysis->_drainBuffer, ANALYSIS_DRAIN_SAMPLES);
+
+            if (captureSize > 0)
+            {
+                processStreamAudio(ctx, &ctx->_capture, ctx->_capture._workspace, analysis->_drainBuffer, captureSize);
+            }
+            else
+            {
+                skipStreamAudio(ctx, &ctx->_capture, takeSampleQueueGap(&analysis->_captureQueue));
+            }
+
+            bDrained = sourceSize == 0 && captureSize == 0;
         }
     }
+}
 
-    return (a - mn) / (mx - mn);
-}
\ No newline at end of file
+void copySamples(
+    const float* samples,
+    const int samplesSize,
+    AudioRing& buffer)
+{
+    writeAudioRing(&buffer, samples, samplesSize);
+}
+
+void debugRender(HowlLibContext* ctx, AudioRing* ring, const char* name, int index)
+{
+#ifdef HOWL_DEBUG_RENDER
+    char path[64];
+
+    snprintf(path, sizeof(path), "./%s_%d.png", name, index);
+
+    writeDebugRender(
+        getAudioRingWindow(ring),
+        ctx->_bufferSize,
+        ctx->_sampleRate,
+        ctx->_config._spectrogramWidth,
+        ctx->_config._spectrogramHeight,
+        path
+    );
+#endif
+}
@@ -1,9 +1,77 @@
 #ifndef __HOWLLIB_H__
+#define __HOWLLIB_H__
 
 struct HowlLibContext;
 
+struct HowlEngine;
+
 typedef void (*fpPreHowlDetected)();
 
+// Details of one matched source/capture pair
+struct HowlMatchEvent
+{
+    long long               _sourcePosition; // Source sample position at the end of the matched window
+    long long               _capturePosition; // Capture sample position at the end of the matched window
+    float                   _score; // Average peak, lower is more alike
+    int                     _sourceIndex; // Render index in its stream, -1 with HOWL_BACKEND_LANDMARK
+    int                     _captureIndex;
+};
+
+typedef void (*fpHowlMatchDetected)(void*, const HowlMatchEvent*);
+
+// Tone found by the streaming detector of the capture stream, before any window is matched
+struct HowlEarlyEvent
+{
+    long long               _capturePosition; // Capture sample position at the end of the stft frame
+    float                   _frequencyHz; // Bin center
+    float                   _paprDb; // Peak to average power of the frame
+    float                   _phprDb; // Peak to harmonic power, lowest of the 2nd and 3rd, 0 when above the band
+};
+
+typedef void (*fpHowlEarlyDetected)(void*, const HowlEarlyEvent*);
+
+// _howlDetection
+#define HOWL_DETECTION_OFF      0
+#define HOWL_DETECTION_EARLY    1 // Early events next to the matching
+#define HOWL_DETECTION_CONFIRM  2 // Early events, and only capture windows holding one are matched
+
+// Matching backends
+#define HOWL_BACKEND_DEFAULT    0 // ArrayFire when built with GPU_SUPPORT, CPU otherwise
+#define HOWL_BACKEND_ARRAYFIRE  1
+#define HOWL_BACKEND_CPU        2 // Native AVX-512/AVX2/scalar kernels
+#define HOWL_BACKEND_FFT        3 // Frequency domain correlation (fftw), O(N log N)
+#define HOWL_BACKEND_LANDMARK   4 // Spectral peak pairs of the capture looked up in a hash index of the source
+
+/**
+ * Per context analysis settings. Start from getHowlLibDefaultConfig and
+ * change what is needed, every buffer is sized from these at init.
+ */
+struct HowlLibConfig
+{
+    int                     _spectrogramWidth; // Stft columns per window
+    int                     _spectrogramHeight; // Frequency bands
+    int                     _overlapPercentage; // Overlap of consecutive snapshots, 0-99
+    double                  _silenceThresholdDb; // Quieter windows are not rendered
+    int                     _maxSpectrograms; // Renders kept per stream for matching
+    float                   _matchThreshold; // Average peak below this is a match
+    float                   _rangeDb; // Dynamic range of the spectrogram images
+    int                     _backend; // HOWL_BACKEND_*
+    int                     _pyramidLevels; // Halvings of the coarse image pairs are scored on first, 0 for full resolution only
+    float                   _pyramidMargin; // Coarse scores below _matchThreshold + this are rescored at full resolution, a heuristic (bench/pyramid), not a bound
+    int                     _minLagMs; // Capture windows are only paired with source windows that end between
+    int                     _maxLagMs; // _minLagMs and _maxLagMs earlier on the aligned clock, both 0 for one buffer either way
+    int                     _delayTracking; // 1 estimates the loop delay (GCC-PHAT) and only matches windows around it
+    float                   _delayCoherence; // Lowest GCC-PHAT peak taken as a coherent path, below it nothing is matched
+    int                     _howlDetection; // HOWL_DETECTION_*
+    float                   _howlPaprDb; // Least peak to average power of a howl candidate bin
+    float                   _howlPhprDb; // Least peak to harmonic power of a howl candidate bin
+    int                     _howlPersistenceMs; // A candidate is detected once it lasted this long
+};
+
+void getHowlLibDefaultConfig(
+    HowlLibConfig*
+);
+
 HowlLibContext* createHowlLibContext();
 
 void destroyHowlLibContext(
@@ -17,6 +85,202 @@ int initHowlLibContext(
     fpPreHowlDetected
 );
 
+int initHowlLibContextBackend(
+    HowlLibContext*, // HowlLib
+    int, // SampleRate
+    int, // Buffer ms
+    fpPreHowlDetected,
+    int // HOWL_BACKEND_*
+);
+
+// Returns -1 when the config is invalid for the sample rate and buffer
+int initHowlLibContextEx(
+    HowlLibContext*, // HowlLib
+    int, // SampleRate
+    int, // Buffer ms
+    fpPreHowlDetected,
+    const HowlLibConfig*
+);
+
+/**
+ * Switches the context to asynchronous analysis, call after init.
+ * Feeds then only copy into a bounded queue of queueMs per stream and
+ * return -1 when it is full. Refused audio counts as silence in the stream
+ * position, so pairing lags stay right, and later feeds of that stream are
+ * refused too until the thread has caught up. Spectrograms, matching and
+ * fpPreHowlDetected run on a library thread. One feeding thread per stream.
+ */
+int startHowlLibAnalysisThread(
+    HowlLibContext*, // HowlLib
+    int // Queue ms
+);
+
+HowlEngine* createHowlEngine();
+
+/**
+ * Hosts many contexts on one shared pool of workers, with one fft plan and
+ * one set of matcher scratch per worker. All contexts of the engine must be
+ * destroyed before the engine.
+ */
+int initHowlEngine(
+    HowlEngine*,
+    int, // SampleRate
+    int, // Buffer ms
+    int, // HOWL_BACKEND_*
+    int // Workers, 0 for one per hardware thread
+);
+
+// All pairs of the engine share the config
+int initHowlEngineEx(
+    HowlEngine*,
+    int, // SampleRate
+    int, // Buffer ms
+    int, // Workers, 0 for one per hardware thread
+    const HowlLibConfig*
+);
+
+void destroyHowlEngine(
+    HowlEngine*
+);
+
+/**
+ * Initializes the context as a pair of the engine instead of
+ * initHowlLibContext. Feeds only enqueue into queues of queueMs and return
+ * -1 when they are full. Workers serve pairs round robin, a bounded slice
+ * of audio at a time. Audio a worker reaches more than deadlineMs after it
+ * was fed is dropped, however short the queue, so detection latency stays
+ * bounded when the engine is overloaded. Detach waits for the pair's
+ * running slice. Dropped and refused audio count as silence in the stream
+ * position, as with startHowlLibAnalysisThread.
+ */
+int initHowlLibContextEngine(
+    HowlLibContext*, // HowlLib
+    HowlEngine*,
+    fpPreHowlDetected,
+    int, // Queue ms
+    int // Deadline ms
+);
+
+/**
+ * Renders are stamped with their stream's sample position and paired by
+ * position, so results do not depend on processing speed. captureLagSamples
+ * is how far the capture stream lags the source, capture position
+ * captureLagSamples lines up with source position 0. Default 0.
+ */
+int setHowlLibStreamAlignment(
+    HowlLibContext*, // HowlLib
+    long long // Capture lag samples
+);
+
+/**
+ * Called with every match next to fpPreHowlDetected, from the same thread.
+ * Call after init, before the first feed. NULL removes it. Matches are
+ * only reported through the callbacks, nothing is printed.
+ */
+int setHowlLibMatchCallback(
+    HowlLibContext*, // HowlLib
+    fpHowlMatchDetected,
+    void* // User data
+);
+
+/**
+ * Called from the thread analysing the capture stream for every tone the
+ * early detector finds, with _howlDetection on. Call after init, before the
+ * first feed. NULL removes it.
+ */
+int setHowlLibEarlyCallback(
+    HowlLibContext*, // HowlLib
+    fpHowlEarlyDetected,
+    void* // User data
+);
+
+// Bucket i counts durations below 2^i microseconds (and at least 2^(i-1)), the last one everything longer
+#define HOWL_STATS_BUCKETS 24
+
+struct HowlLatencyHistogram
+{
+    long long               _count;
+    long long               _totalUs;
+    long long               _maxUs;
+    long long               _buckets[HOWL_STATS_BUCKETS];
+};
+
+/**
+ * Counters since init. Fields are read one by one while the pipeline
+ * runs, compare deltas between two queries rather than fields of one.
+ */
+struct HowlLibStats
+{
+    long long               _sourceSamples; // Accepted by feedSourceAudio
+    long long               _captureSamples; // Accepted by feedCaptureAudio
+    long long               _droppedSamples; // Refused by a full queue, analysed as silence
+    long long               _lateSamples; // Skipped by an engine pair past its deadline, analysed as silence
+    long long               _snapshots; // Windows rendered and matched
+    long long               _silentSnapshots; // Windows below the silence threshold
+    long long               _pairsScored;
+    long long               _pairsSkipped; // Outside the lag range
+    long long               _pairsCoarse; // Scored, but rejected on the coarse image without a full resolution match
+    long long               _matches;
+    long long               _errors; // Allocation or backend failures, also reported on stderr
+    long long               _incoherentSnapshots; // Capture windows without a coherent path to the source, with _delayTracking
+    long long               _loopDelaySamples; // Latest loop delay estimate, capture behind source
+    float                   _loopDelayCoherence; // Its GCC-PHAT peak, 0 for none
+    long long               _landmarks; // Hashed from both streams, with HOWL_BACKEND_LANDMARK
+    long long               _earlyDetections; // Tones found by the early detector
+    long long               _unflaggedSnapshots; // Capture windows without an early detection, not matched with HOWL_DETECTION_CONFIRM
+    HowlLatencyHistogram    _spectrogram; // Stft and render work per snapshot
+    HowlLatencyHistogram    _matching; // Backend time per snapshot
+    HowlLatencyHistogram    _peaks; // Normalize and peak scoring per snapshot
+    HowlLatencyHistogram    _detection; // Feed of the window's last sample to its scores
+    HowlLatencyHistogram    _feed; // feedSourceAudio/feedCaptureAudio calls, entry to return, queued or not
+};
+
+// Lock-free, callable from any thread while the context is fed
+int getHowlLibStats(
+    HowlLibContext*, // HowlLib
+    HowlLibStats*
+);
+
+/**
+ * Records spans of every context (feeds, renders, matching, normalize,
+ * peaks, callbacks) into per thread buffers, written to path as Chrome
+ * trace-event JSON by a library thread until stopHowlLibTrace. Open the
+ * file in chrome://tracing or Perfetto. Off by default, then a span costs
+ * one relaxed load. Buffers are allocated here and by the library thread,
+ * a thread's first span takes one without allocating or waiting, and is
+ * dropped if none is ready. A thread's buffer is freed once it exits and
+ * its spans are written. A trace still running at exit is stopped.
+ * Returns -1 if a trace is already running.
+ */
+int startHowlLibTrace(
+    const char* // Path
+);
+
+void stopHowlLibTrace();
+
+/**
+ * Offline mode for a context initialized with initHowlLibContext* and no
+ * analysis thread: reads source and capture from files and feeds them as
+ * fast as the CPU allows, chunk samples of each stream in turn. Anything
+ * libsndfile reads (wav, aiff, flac) is mixed down to mono, other files
+ * are read as raw native endian float32 mono, the format of the test
+ * dumps. Sample rates must match the context. Returns the samples fed to
+ * the longer stream, -1 on error.
+ */
+long long runHowlLibOffline(
+    HowlLibContext*, // HowlLib
+    const char*, // Source path
+    const char*, // Capture path
+    int // Chunk samples
+);
+
+/**
+ * Threading: source and capture may each be fed from their own thread,
+ * in parallel. Feeding the same stream from two threads is not allowed.
+ * Each stream renders on its feeding thread and matches against a
+ * snapshot of the other stream, so fpPreHowlDetected can be called from
+ * both threads at once. Init and destroy must not overlap any feed.
+ */
 int feedSourceAudio(
     HowlLibContext*,
     float*,
@@ -4,6 +4,7 @@
 #include <signal.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <sstream>
 #include <thread>
 #include <atomic>
@@ -12,7 +13,7 @@
 #include <howl.h>
 #include <deque>
 #include <soundio/soundio.h>
-// #include <chrono>
+#include <chrono>
 
 #define SAMPLES_SIZE 4096
 #define SAMPLE_RATE 44100
@@ -53,6 +54,10 @@ static int min_int(int a, int b) {
     return (a < b) ? a : b;
 }
 
+typedef int(*howlfeedfn)(HowlLibContext*, float*, int);
+
+static void feedLoop(HowlLibContext*, struct RecordContext*, howlfeedfn, const char*);
+
 static void read_callback(struct SoundIoInStream *instream, int frame_count_min, int frame_count_max);
 static void overflow_callback(struct SoundIoInStream *instream);
 
@@ -62,6 +67,37 @@ static void preHowlDetected()
     fprintf(stdout, "Similar audio detected!\n");
 }
 
+static void matchDetected(void* userData, const HowlMatchEvent* event)
+{
+    fprintf(stdout, "MATCH %f - source_%d capture_%d!\n", event->_score, event->_sourceIndex, event->_captureIndex);
+}
+
+static void feedLoop(HowlLibContext* howlLib,
+                        struct RecordContext* rc,
+                        howlfeedfn feed,
+                        const char* name)
+{
+    for(;!quit;)
+    {
+        int fill_bytes = soundio_ring_buffer_fill_count(rc->ring_buffer);
+
+        if (fill_bytes == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        char *read_buf = soundio_ring_buffer_read_ptr(rc->ring_buffer);
+
+        if (0 != feed(howlLib, (float*)read_buf, fill_bytes / sizeof(float)))
+        {
+            fprintf(stderr, "Failed to feed %s audio...\n", name);
+        }
+
+        soundio_ring_buffer_advance_read_ptr(rc->ring_buffer, fill_bytes);
+    }
+}
+
 void quitHandler(int dummy)
 {
     // fprintf(stdout, "QUIT!\n");
@@ -125,6 +161,18 @@ int main(int argc, const char** argv)
         return -1;
     }
 
+    setHowlLibMatchCallback(howlLib, matchDetected, NULL);
+
+    // ./howl --async : analysis runs on the library thread, feeds only enqueue
+    if (argc > 1 && 0 == strcmp(argv[1], "--async"))
+    {
+        if (0 != startHowlLibAnalysisThread(howlLib, 2000))
+        {
+            fprintf(stderr, "Failed to start analysis thread!\n");
+            return -1;
+        }
+    }
+
     soundio_device_sort_channel_layouts(sourceDevice);
 
     soundio_device_sort_channel_layouts(captureDevice);
@@ -178,6 +226,11 @@ int main(int argc, const char** argv)
         return 1;
     }
 
+    // Each stream is fed from its own thread, libhowl analyses them in parallel
+    sourceFeedThread = std::thread(feedLoop, howlLib, &rcSource, feedSourceAudio, "source");
+
+    captureFeedThread = std::thread(feedLoop, howlLib, &rcCapture, feedCaptureAudio, "capture");
+
     for(;!quit;)
     {
         if (select(1, &stdset, NULL, NULL, &tv) < 0)
@@ -201,45 +254,11 @@ int main(int argc, const char** argv)
         FD_SET(fileno(stdin), &stdset);
 
         soundio_flush_events(soundio);
+    }
 
-        {
-            int fill_bytes = soundio_ring_buffer_fill_count(rcSource.ring_buffer);
-            char *read_buf = soundio_ring_buffer_read_ptr(rcSource.ring_buffer);
-
-            // fprintf(stdout, "%d\n", fill_bytes);
-
-            if (0 != feedSourceAudio(howlLib, (float*)read_buf, fill_bytes / sizeof(float)))
-            {
-                fprintf(stderr, "Failed to feed source audio...\n");
-            }
-
-            // size_t amt = fwrite(read_buf, 1, fill_bytes, out_f1);
-            // if ((int)amt != fill_bytes) {
-            //     fprintf(stderr, "write error: %s\n", strerror(errno));
-            //     return 1;
-            // }
-            // fprintf(stdout, "source %d\n", fill_bytes);
-            soundio_ring_buffer_advance_read_ptr(rcSource.ring_buffer, fill_bytes);
-        }
-
-        {
-            int fill_bytes = soundio_ring_buffer_fill_count(rcCapture.ring_buffer);
-            char *read_buf = soundio_ring_buffer_read_ptr(rcCapture.ring_buffer);
+    sourceFeedThread.join();
 
-            if (0 != feedCaptureAudio(howlLib, (float*) read_buf, fill_bytes / sizeof(float)))
-            {
-                fprintf(stderr, "Failed to feed capture audio...\n");
-            }
-
-            // size_t amt = fwrite(read_buf, 1, fill_bytes, out_f);
-            // if ((int)amt != fill_bytes) {
-            //     fprintf(stderr, "write error: %s\n", strerror(errno));
-            //     return 1;
-            // }
-            // fprintf(stdout, "capture %d\n", fill_bytes);
-            soundio_ring_buffer_advance_read_ptr(rcCapture.ring_buffer, fill_bytes);
-        }
-    }
+    captureFeedThread.join();
 
     fprintf(stdout, "exit...\n");
 
@@ -250,10 +269,6 @@ int main(int argc, const char** argv)
                 sourceDevice,
                 captureDevice);
 
-    // sourceFeedThread.join();
-
-    // captureFeedThread.join();
-
     destroyHowlLibContext(howlLib);
 
     return 0;
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include <howl.h>
+
+#define SAMPLE_RATE 44100
+#define BUFFER_MS 3000
+#define CHUNK_SAMPLES 4096
+
+struct OfflineStats
+{
+    int sampleRate;
+    int matches;
+};
+
+static void matchDetected(void* userData, const HowlMatchEvent* event)
+{
+    OfflineStats* stats = (OfflineStats*)userData;
+
+    stats->matches++;
+
+    printf("match %f source_%d @%lld (%.3fs) capture_%d @%lld (%.3fs)\n",
+           event->_score,
+           event->_sourceIndex,
+           event->_sourcePosition,
+           (double)event->_sourcePosition / stats->sampleRate,
+           event->_captureIndex,
+           event->_capturePosition,
+           (double)event->_capturePosition / stats->sampleRate);
+}
+
+static void printHistogram(const char* name, const HowlLatencyHistogram* histogram)
+{
+    printf("%-12s %8lld calls, avg %8.1fus, max %8lldus\n",
+           name,
+           histogram->_count,
+           histogram->_count > 0 ? (double)histogram->_totalUs / histogram->_count : 0.0,
+           histogram->_maxUs);
+}
+
+static void usage()
+{
+    fprintf(stderr,
+            "usage: howl_offline [options] source capture\n"
+            "  -b cpu|fft|af|landmark  matching backend\n"
+            "  -r rate         sample rate of both inputs, default %d\n"
+            "  -m ms           analysis buffer, default %d\n"
+            "  -c samples      feed chunk, default %d\n"
+            "  -l samples      capture lag behind source, default 0\n"
+            "  -p levels       score on a coarse image first, default 0\n"
+            "  -e 0|1|2        early howl detection: off, events, confirm only flagged windows\n"
+            "inputs are wav/aiff/flac, or raw float32 mono (sourceraw, captureraw)\n",
+            SAMPLE_RATE, BUFFER_MS, CHUNK_SAMPLES);
+}
+
+int main(int argc, char** argv)
+{
+    int backend = HOWL_BACKEND_DEFAULT;
+    int sampleRate = SAMPLE_RATE;
+    int bufferMs = BUFFER_MS;
+    int chunk = CHUNK_SAMPLES;
+    long long lag = 0;
+    int pyramidLevels = 0;
+    int howlDetection = HOWL_DETECTION_OFF;
+
+    int i = 1;
+
+    for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+    {
+        const char* value = argv[i + 1];
+
+        if (!strcmp(argv[i], "-b"))
+        {
+            backend = !strcmp(value, "cpu") ? HOWL_BACKEND_CPU :
+                      !strcmp(value, "fft") ? HOWL_BACKEND_FFT :
+                      !strcmp(value, "af") ? HOWL_BACKEND_ARRAYFIRE :
+                      !strcmp(value, "landmark") ? HOWL_BACKEND_LANDMARK : -1;
+        }
+        else if (!strcmp(argv[i], "-r"))
+        {
+            sampleRate = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-m"))
+        {
+            bufferMs = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            chunk = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-l"))
+        {
+            lag = atoll(value);
+        }
+        else if (!strcmp(argv[i], "-p"))
+        {
+            pyramidLevels = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-e"))
+        {
+            howlDetection = atoi(value);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc - i != 2)
+    {
+        usage();
+        return 1;
+    }
+
+    HowlLibConfig config;
+
+    getHowlLibDefaultConfig(&config);
+
+    config._backend = backend;
+    config._pyramidLevels = pyramidLevels;
+    config._howlDetection = howlDetection;
+
+    HowlLibContext* howlLib = createHowlLibContext();
+
+    if (!howlLib ||
+        0 != initHowlLibContextEx(howlLib, sampleRate, bufferMs, NULL, &config))
+    {
+        fprintf(stderr, "failed to init howl lib\n");
+        destroyHowlLibContext(howlLib);
+        return 1;
+    }
+
+    OfflineStats stats;
+
+    stats.sampleRate = sampleRate;
+    stats.matches = 0;
+
+    setHowlLibMatchCallback(howlLib, matchDetected, &stats);
+    setHowlLibStreamAlignment(howlLib, lag);
+
+    auto start = std::chrono::steady_clock::now();
+
+    long long samples = runHowlLibOffline(howlLib, argv[i], argv[i + 1], chunk);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    HowlLibStats libStats;
+
+    getHowlLibStats(howlLib, &libStats);
+
+    destroyHowlLibContext(howlLib);
+
+    if (samples < 0)
+    {
+        fprintf(stderr, "failed to process %s %s\n", argv[i], argv[i + 1]);
+        return 1;
+    }
+
+    const double seconds = (double)samples / sampleRate;
+
+    printf("%lld snapshots, %lld silent, %lld pairs scored (%lld coarse only), %lld skipped, %lld errors\n",
+           libStats._snapshots,
+           libStats._silentSnapshots,
+           libStats._pairsScored,
+           libStats._pairsCoarse,
+           libStats._pairsSkipped,
+           libStats._errors);
+
+    if (howlDetection != HOWL_DETECTION_OFF)
+    {
+        printf("%lld early detections, %lld capture windows not flagged\n",
+               libStats._earlyDetections,
+               libStats._unflaggedSnapshots);
+    }
+
+    printHistogram("spectrogram", &libStats._spectrogram);
+    printHistogram("matching", &libStats._matching);
+    printHistogram("peaks", &libStats._peaks);
+    printHistogram("detection", &libStats._detection);
+    printHistogram("feed", &libStats._feed);
+
+    printf("%d matches, %.2fs of audio in %.3fs, %.1fx realtime\n",
+           stats.matches,
+           seconds,
+           elapsed,
+           elapsed > 0.0 ? seconds / elapsed : 0.0);
+
+    return 0;
+}